@@ -0,0 +1,125 @@
+#include "http_conn/http_conn.hh"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <new>
+
+//allocations per request on the way through http_conn: reading, parsing, building the response, writing it
+//the connection sits on one end of a socketpair, the bench on the other, so nothing but the request path runs
+//operator new is counted here, and blocks buffer_pool takes from malloc() by its stats
+
+using namespace std;
+
+static size_t n_new = 0;
+
+void *operator new(size_t size)
+{
+    ++n_new;
+    if (void *p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p,size_t) noexcept
+{
+    free(p);
+}
+
+static size_t pool_mallocs()
+{
+    size_t n = buffer_pool::oversize();
+    for (size_t c(0); c < buffer_pool::nclass; ++c) {
+        n += buffer_pool::class_stats(c).mallocs;
+    }
+    return n;
+}
+
+static void make_root(const string &root)
+{
+    mkdir(root.c_str(),0755);
+    ofstream(root + "/index.html") << string(2048,'i');
+    ofstream(root + "/a.css") << string(512,'c');
+    ofstream(root + "/big.bin") << string(1 << 20,'b');
+}
+
+//serve one batch of requests sent as one write, and take the responses off the other end
+static void serve(http_conn &conn,int peer,const string &reqs)
+{
+    static char sink[1 << 16];
+    if (write(peer,reqs.data(),reqs.size()) != static_cast<ssize_t>(reqs.size())) {
+        throw runtime_error("write error");
+    }
+    conn.read();
+    while (conn.ready_for_write()) {
+        ssize_t len;
+        while ((len = conn.write()) != 0) {
+            //the other end is full; make room
+            while (read(peer,sink,sizeof(sink)) == sizeof(sink));
+        }
+        conn.reset();
+    }
+    while (read(peer,sink,sizeof(sink)) > 0);
+}
+
+static void run(const char *name,const string &reqs,size_t per_batch,const http_conn::config &conf)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX,SOCK_STREAM | SOCK_NONBLOCK,0,fds) < 0) {
+        throw runtime_error("socketpair error");
+    }
+    sockaddr_in addr{};
+    http_conn conn(conf);
+    conn.open(fds[0],addr);
+    //warm up: buffers, arena blocks and cache entries are taken the first time only
+    for (size_t i(0); i < 16; ++i) {
+        serve(conn,fds[1],reqs);
+    }
+    const size_t rounds = 10000;
+    auto news = n_new;
+    auto mallocs = pool_mallocs();
+    for (size_t i(0); i < rounds; ++i) {
+        serve(conn,fds[1],reqs);
+    }
+    double n = static_cast<double>(rounds * per_batch);
+    cout << "  " << name << ": " << (n_new - news) / n << " operator new, " << (pool_mallocs() - mallocs) / n << " buffer_pool malloc() per request" << endl;
+    conn.close();
+    close(fds[1]);
+}
+
+static string get(const string &path)
+{
+    return "GET " + path + " HTTP/1.1\r\nHost: localhost\r\nUser-Agent: alloc_bench\r\nAccept: */*\r\nConnection: keep-alive\r\n\r\n";
+}
+
+int main()
+{
+    const string root = "/tmp/alloc_bench_root";
+    make_root(root);
+    http_conn::config conf{root,{}};
+    http_conn::set_trigger(true);
+    file_cache cache(root,64,true,32768,1 << 20);
+    for (bool cached : {true,false}) {
+        http_response::set_file_cache(cached ? &cache : nullptr);
+        cout << (cached ? "file cache on" : "file cache off") << endl;
+        run("small file      ",get("/index.html"),1,conf);
+        run("index page      ",get("/"),1,conf);
+        run("query string    ",get("/a.css?v=3&t=1678901234"),1,conf);
+        run("not found       ",get("/no/such/file.js"),1,conf);
+        run("large file      ",get("/big.bin"),1,conf);
+        run("8 pipelined     ",get("/index.html") + get("/a.css") + get("/") + get("/nope") + get("/index.html") + get("/a.css?x") + get("/") + get("/a.css"),8,conf);
+    }
+    return 0;
+}
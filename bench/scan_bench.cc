@@ -0,0 +1,134 @@
+#include "simd_scan/simd_scan.hh"
+
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+//line ends of browser-sized request headers, found the way the parser does: one line after another
+//simd_scan against std::search and the memchr() loop the parser had before
+//bytes per cycle are by TSC, which ticks at the nominal frequency; hot cache
+
+using namespace std;
+
+static const char crlf[] = "\r\n";
+
+static size_t by_search(const char *p,size_t len)
+{
+    return search(p,p + len,crlf,crlf + 2) - p;
+}
+
+static size_t by_memchr(const char *p,size_t len)
+{
+    size_t i = 0;
+    while (i + 1 < len) {
+        auto cr = static_cast<const char *>(memchr(p + i,'\r',len - 1 - i));
+        if (!cr) {
+            break;
+        }
+        i = cr - p;
+        if (p[i + 1] == '\n') {
+            return i;
+        }
+        ++i;
+    }
+    return len;
+}
+
+static size_t by_simd(const char *p,size_t len)
+{
+    return simd_scan::find_crlf(p,len);
+}
+
+static string header_set(size_t cookie_len)
+{
+    string s = "GET /static/js/app.4f2a1c.js?v=20230316 HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "Connection: keep-alive\r\n"
+        "sec-ch-ua: \"Chromium\";v=\"110\", \"Not A(Brand\";v=\"24\", \"Google Chrome\";v=\"110\"\r\n"
+        "sec-ch-ua-mobile: ?0\r\n"
+        "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/110.0.0.0 Safari/537.36 Edg/110.0.1587.63\r\n"
+        "sec-ch-ua-platform: \"Windows\"\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+        "Sec-Fetch-Site: same-origin\r\n"
+        "Sec-Fetch-Mode: no-cors\r\n"
+        "Sec-Fetch-Dest: script\r\n"
+        "Referer: https://www.example.com/account/settings/notifications?tab=email&utm_source=newsletter\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8,en-GB;q=0.7,en-US;q=0.6\r\n";
+    //session ids, analytics and consent cookies, as long as sites make them
+    string cookie = "Cookie: ";
+    for (size_t i(0); cookie.size() < cookie_len; ++i) {
+        cookie += "_ga_" + to_string(i * 7919 % 100000) + "=GS1.1.1678901234.12.1.1678905678.0.0.0; ";
+    }
+    s += cookie + "\r\n\r\n";
+    return s;
+}
+
+static uint64_t ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static double seconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//every line end of s, rounds times over
+template <typename F>
+static void run(const char *name,const string &s,size_t rounds,F find)
+{
+    size_t found = 0;
+    auto t0 = ticks();
+    auto s0 = seconds();
+    for (size_t r(0); r < rounds; ++r) {
+        const char *p = s.data();
+        size_t len = s.size();
+        size_t pos = 0;
+        while (pos < len) {
+            auto i = pos + find(p + pos,len - pos);
+            if (i >= len) {
+                break;
+            }
+            ++found;
+            pos = i + 2;
+        }
+        //keep the compiler from hoisting the scan out of the loop
+        asm volatile("" : : "r"(p) : "memory");
+    }
+    auto t = ticks() - t0;
+    auto sec = seconds() - s0;
+    double bytes = static_cast<double>(s.size()) * rounds;
+    cout << "  " << name << ": " << bytes / sec / 1e9 << " GB/s";
+    if (t) {
+        cout << ", " << bytes / t << " bytes/cycle";
+    }
+    cout << " (" << found / rounds << " lines)" << endl;
+}
+
+int main()
+{
+    cout << "kernels: " << simd_scan::name() << endl;
+    for (size_t cookie : {0,1024,4096}) {
+        auto s = header_set(cookie);
+        size_t rounds = (256 << 20) / s.size();
+        cout << s.size() << " bytes of headers, cookie of " << cookie << " bytes" << endl;
+        run("std::search",s,rounds,by_search);
+        run("memchr    ",s,rounds,by_memchr);
+        run("simd_scan ",s,rounds,by_simd);
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "thread_pool/thread_pool.hh"
+
+#include <time.h>
+
+#include <iostream>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+//tasks per second handed over as small_task, against the std::function the pool took before
+//a task carries what a connection task does: a kind, a timestamp, two pointers and a shared_ptr, too large for std::function to keep in place
+//handoff: one thread pushing into and popping from a ring, which is the cost of the handover itself
+//pool: one thread pushing into the pool, every task counted by a worker, in both scheduling modes
+
+using namespace std;
+
+static double seconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct payload {
+    atomic<size_t> done{0};
+};
+
+//what the server captures per connection task
+static auto make_task(uint8_t kind,uint32_t stamp,void *server,const shared_ptr<payload> &p)
+{
+    return [kind,stamp,server,r = p.get(),conn = p]() {
+        //carried along as a connection task carries them, and not looked at
+        (void)kind;
+        (void)stamp;
+        (void)server;
+        (void)r;
+        conn->done.fetch_add(1,memory_order_relaxed);
+    };
+}
+
+static small_task as_small_task(uint32_t i,const shared_ptr<payload> &p)
+{
+    return small_task(make_task(0,i,nullptr,p));
+}
+
+static small_task as_function(uint32_t i,const shared_ptr<payload> &p)
+{
+    return small_task(function<void ()>(make_task(0,i,nullptr,p)));
+}
+
+template <typename F>
+static void handoff(const char *name,size_t n,F make)
+{
+    auto p = make_shared<payload>();
+    task_ring ring(1024);
+    small_task task;
+    auto t0 = seconds();
+    for (size_t i(0); i < n; ++i) {
+        ring.push(make(i,p),1024);
+        ring.pop(task);
+        task();
+        task = nullptr;
+    }
+    auto sec = seconds() - t0;
+    cout << "  " << name << ": " << n / sec / 1e6 << " M tasks/s" << endl;
+}
+
+template <typename F>
+static void pool(const char *name,size_t n,bool work_stealing,F make)
+{
+    auto p = make_shared<payload>();
+    thread_pool tp(4,65536,work_stealing);
+    auto t0 = seconds();
+    for (size_t i(0); i < n; ++i) {
+        //run by the pushing thread if full, as the server does
+        auto task = make(i,p);
+        if (!tp.push(move(task),i)) {
+            task();
+        }
+    }
+    while (p->done.load(memory_order_relaxed) < n) {
+        sched_yield();
+    }
+    auto sec = seconds() - t0;
+    cout << "  " << name << ": " << n / sec / 1e6 << " M tasks/s" << endl;
+}
+
+int main()
+{
+    const size_t n = 4000000;
+    cout << "handoff through task_ring" << endl;
+    handoff("small_task   ",n,as_small_task);
+    handoff("std::function",n,as_function);
+    cout << "thread_pool, shared queue, 4 workers" << endl;
+    pool("small_task   ",n,false,as_small_task);
+    pool("std::function",n,false,as_function);
+    cout << "thread_pool, work stealing, 4 workers" << endl;
+    pool("small_task   ",n,true,as_small_task);
+    pool("std::function",n,true,as_function);
+    return 0;
+}
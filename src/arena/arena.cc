@@ -0,0 +1,55 @@
+#include "arena.hh"
+
+using namespace std;
+
+string_view arena::concat(initializer_list<string_view> parts)
+{
+    size_t len(0);
+    for (auto &s : parts) {
+        len += s.size();
+    }
+    auto p = static_cast<char *>(alloc(len + 1));
+    size_t off(0);
+    for (auto &s : parts) {
+        memcpy(p + off,s.data(),s.size());
+        off += s.size();
+    }
+    p[len] = 0;
+    return string_view(p,len);
+}
+
+void arena::reset()
+{
+    if (!last) {
+        return;
+    }
+    while (last->prev) {
+        auto prev = last->prev;
+        buffer_pool::put(reinterpret_cast<char *>(last),last->size);
+        last = prev;
+    }
+    cur = reinterpret_cast<char *>(last) + header;
+    end = reinterpret_cast<char *>(last) + last->size;
+}
+
+void arena::release()
+{
+    while (last) {
+        auto prev = last->prev;
+        buffer_pool::put(reinterpret_cast<char *>(last),last->size);
+        last = prev;
+    }
+    cur = end = nullptr;
+}
+
+void arena::grow(size_t size)
+{
+    //the smallest class does for most batches, which take a path or two per request
+    size_t got = max(header + size,buffer_pool::class_size[0]);
+    auto b = reinterpret_cast<block *>(buffer_pool::get(got));
+    b->prev = last;
+    b->size = got;
+    last = b;
+    cur = reinterpret_cast<char *>(b) + header;
+    end = reinterpret_cast<char *>(b) + got;
+}
@@ -0,0 +1,61 @@
+#ifndef ARENA_HH
+#define ARENA_HH
+
+#include "buffer_pool/buffer_pool.hh"
+
+#include <string.h>
+#include <stddef.h>
+
+#include <string>
+#include <string_view>
+#include <initializer_list>
+#include <algorithm>
+
+//bump allocator for what a batch of requests builds while being answered, on blocks of buffer_pool
+//nothing is freed one by one; reset() frees all at once, keeping the first block for the next batch
+//one per connection, used by the thread serving it only
+
+class arena
+{
+public:
+    arena() = default;
+    arena(const arena &) = delete;
+    arena &operator=(const arena &) = delete;
+    ~arena() {
+        release();
+    }
+    //size bytes, aligned for any scalar type
+    void *alloc(size_t size) {
+        size = (size + align - 1) & ~(align - 1);
+        if (static_cast<size_t>(end - cur) < size) {
+            grow(size);
+        }
+        auto p = cur;
+        cur += size;
+        return p;
+    }
+    //the strings given joined, NUL-terminated, so that the data can be passed to system calls as is
+    std::string_view concat(std::initializer_list<std::string_view> parts);
+    //free everything allocated, keeping the first block
+    void reset();
+    //give every block back
+    void release();
+
+private:
+    static const size_t align = alignof(max_align_t);
+    //at the head of every block, chaining them from the last one taken
+    struct block {
+        block *prev;
+        size_t size;
+    };
+    static const size_t header = (sizeof(block) + align - 1) & ~(align - 1);
+
+    block *last = nullptr;
+    char *cur = nullptr;
+    char *end = nullptr;
+
+    //take a block with at least size bytes free
+    void grow(size_t size);
+};
+
+#endif //ARENA_HH
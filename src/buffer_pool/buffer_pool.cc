@@ -0,0 +1,133 @@
+#include "buffer_pool.hh"
+
+using namespace std;
+
+buffer_pool::depot buffer_pool::depots[nclass];
+atomic<size_t> buffer_pool::n_oversize{0};
+
+buffer_pool::thread_cache::thread_cache()
+{
+    //room for a full cache, so that caching allocates nothing later
+    for (size_t c(0); c < nclass; ++c) {
+        blocks[c].reserve(cache_limit(c));
+    }
+}
+
+buffer_pool::thread_cache::~thread_cache()
+{
+    if (scratch) {
+        blocks[class_of(max_block)].push_back(scratch);
+    }
+    for (size_t c(0); c < nclass; ++c) {
+        drain(*this,c,blocks[c].size());
+    }
+}
+
+buffer_pool::thread_cache &buffer_pool::local()
+{
+    thread_local thread_cache tc;
+    return tc;
+}
+
+char *buffer_pool::get(size_t &size)
+{
+    auto c = class_of(size);
+    if (c == nclass) {
+        n_oversize.fetch_add(1,memory_order_relaxed);
+        auto p = static_cast<char *>(malloc(size));
+        if (!p) {
+            throw runtime_error("malloc error");
+        }
+        return p;
+    }
+    size = class_size[c];
+    auto &tc = local();
+    if (tc.blocks[c].empty()) {
+        refill(tc,c);
+    }
+    auto p = tc.blocks[c].back();
+    tc.blocks[c].pop_back();
+    return p;
+}
+
+void buffer_pool::put(char *block,size_t size)
+{
+    auto c = class_of(size);
+    if (c == nclass) {
+        free(block);
+        return;
+    }
+    auto &tc = local();
+    if (tc.blocks[c].size() == cache_limit(c)) {
+        drain(tc,c,cache_limit(c) / 2);
+    }
+    tc.blocks[c].push_back(block);
+}
+
+char *buffer_pool::scratch()
+{
+    auto &tc = local();
+    if (!tc.scratch) {
+        size_t size = max_block;
+        tc.scratch = get(size);
+    }
+    return tc.scratch;
+}
+
+buffer_pool::stats buffer_pool::class_stats(size_t c)
+{
+    stats s;
+    auto &d = depots[c];
+    s.mallocs = d.mallocs.load(memory_order_relaxed);
+    s.frees = d.frees.load(memory_order_relaxed);
+    pthread_mutex_lock(&d.mutex);
+    s.depot = d.blocks.size();
+    pthread_mutex_unlock(&d.mutex);
+    return s;
+}
+
+void buffer_pool::refill(thread_cache &tc,size_t c)
+{
+    auto &d = depots[c];
+    auto want = max(cache_limit(c) / 2,static_cast<size_t>(1));
+    pthread_mutex_lock(&d.mutex);
+    while (want && !d.blocks.empty()) {
+        tc.blocks[c].push_back(d.blocks.back());
+        d.blocks.pop_back();
+        --want;
+    }
+    pthread_mutex_unlock(&d.mutex);
+    //the depot is short; new blocks, one at a time, as they may well be enough
+    if (tc.blocks[c].empty()) {
+        auto p = static_cast<char *>(malloc(class_size[c]));
+        if (!p) {
+            throw runtime_error("malloc error");
+        }
+        d.mallocs.fetch_add(1,memory_order_relaxed);
+        tc.blocks[c].push_back(p);
+    }
+}
+
+void buffer_pool::drain(thread_cache &tc,size_t c,size_t n)
+{
+    auto &d = depots[c];
+    auto &blocks = tc.blocks[c];
+    size_t freed(0);
+    pthread_mutex_lock(&d.mutex);
+    //the room is reserved once, as the first blocks come in
+    if (d.blocks.capacity() == 0) {
+        d.blocks.reserve(depot_bytes / class_size[c]);
+    }
+    for (; n; --n) {
+        if (d.blocks.size() < depot_bytes / class_size[c]) {
+            d.blocks.push_back(blocks.back());
+        }
+        else {
+            free(blocks.back());
+            ++freed;
+        }
+        blocks.pop_back();
+    }
+    pthread_mutex_unlock(&d.mutex);
+    d.frees.fetch_add(freed,memory_order_relaxed);
+}
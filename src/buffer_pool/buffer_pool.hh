@@ -0,0 +1,82 @@
+#ifndef BUFFER_POOL_HH
+#define BUFFER_POOL_HH
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <vector>
+#include <atomic>
+#include <stdexcept>
+
+//memory blocks of a few fixed sizes for buffers, so that steady request handling mallocs nothing
+//every thread keeps blocks freed in a cache of its own, taking and giving them by batches from and to a depot shared by all
+//a block may be freed by a thread other than the one getting it
+//blocks larger than the largest size class come from malloc(), as they're rare
+
+class buffer_pool
+{
+public:
+    static const size_t nclass = 4;
+    static constexpr size_t class_size[nclass] = {4096,8192,16384,65536};
+    static const size_t max_block = 65536;
+
+    //a block of at least size bytes; size is set to the size got, which must be given back to put()
+    static char *get(size_t &size);
+    static void put(char *block,size_t size);
+    //max_block bytes of the calling thread's own, for data coming more than a buffer can take
+    static char *scratch();
+
+    struct stats {
+        size_t mallocs = 0; //<blocks got from malloc()
+        size_t frees = 0;   //<blocks given back to free()
+        size_t depot = 0;   //<blocks in the depot
+    };
+    static stats class_stats(size_t c);
+    //blocks beyond the size classes, all malloc()ed
+    static size_t oversize() {
+        return n_oversize.load(std::memory_order_relaxed);
+    }
+
+private:
+    //blocks a thread caches of every class, 256 KB worth
+    static const size_t cache_bytes = 262144;
+    //blocks the depot keeps of every class, 4 MB worth; the rest go back to free()
+    static const size_t depot_bytes = 4194304;
+
+    struct depot {
+        pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+        std::vector<char *> blocks;
+        std::atomic<size_t> mallocs{0};
+        std::atomic<size_t> frees{0};
+    };
+    //a thread's cache; blocks go back to the depot as the thread exits
+    struct thread_cache {
+        std::vector<char *> blocks[nclass];
+        char *scratch = nullptr;
+        thread_cache();
+        ~thread_cache();
+    };
+
+    static depot depots[nclass];
+    static std::atomic<size_t> n_oversize;
+
+    static thread_cache &local();
+    //class of a block of size, or nclass if too large
+    static size_t class_of(size_t size) {
+        for (size_t c(0); c < nclass; ++c) {
+            if (size <= class_size[c]) {
+                return c;
+            }
+        }
+        return nclass;
+    }
+    static size_t cache_limit(size_t c) {
+        return cache_bytes / class_size[c];
+    }
+    //refill the empty cache of class c by half its limit
+    static void refill(thread_cache &tc,size_t c);
+    //give half of the full cache of class c back
+    static void drain(thread_cache &tc,size_t c,size_t n);
+};
+
+#endif //BUFFER_POOL_HH
@@ -0,0 +1,120 @@
+#include "conn_pool.hh"
+
+using namespace std;
+
+conn_pool::conn_pool(const http_conn::config &conf,size_t slab_size)
+    : conf(conf),
+    slab_size(max(slab_size,static_cast<size_t>(1)))
+{
+    if (pthread_mutex_init(&mutex,nullptr) < 0) {
+        throw runtime_error("pthread_mutex_init error");
+    }
+}
+
+conn_pool::~conn_pool()
+{
+    for (auto slab : slabs) {
+        for (size_t i(0); i < slab_size; ++i) {
+            slab[i].~http_conn();
+        }
+        ::operator delete(slab);
+    }
+    for (auto block : free_blocks) {
+        ::operator delete(block);
+    }
+    pthread_mutex_destroy(&mutex);
+}
+
+shared_ptr<http_conn> conn_pool::acquire(int fd,const sockaddr_in &addr)
+{
+    pthread_mutex_lock(&mutex);
+    if (free_conns.empty()) {
+        try {
+            grow();
+        }
+        catch (...) {
+            pthread_mutex_unlock(&mutex);
+            throw;
+        }
+    }
+    auto conn = free_conns.back();
+    free_conns.pop_back();
+    pthread_mutex_unlock(&mutex);
+    conn->open(fd,addr);
+    //the recycler takes it back if this throws
+    return shared_ptr<http_conn>(conn,recycler{this},block_allocator<http_conn>(this));
+}
+
+conn_pool::stats conn_pool::get_stats() const
+{
+    stats s;
+    pthread_mutex_lock(&mutex);
+    s.made = slabs.size() * slab_size;
+    s.free = free_conns.size();
+    pthread_mutex_unlock(&mutex);
+    return s;
+}
+
+void conn_pool::recycler::operator()(http_conn *conn) const
+{
+    //the socket is closed only now, so that no one holding the object may touch an fd reused by another connection
+    conn->close();
+    pthread_mutex_lock(&pool->mutex);
+    pool->free_conns.push_back(conn);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void conn_pool::grow()
+{
+    slabs.reserve(slabs.size() + 1);
+    free_conns.reserve((slabs.size() + 1) * slab_size);
+    auto slab = static_cast<http_conn *>(::operator new(slab_size * sizeof(http_conn)));
+    for (size_t i(0); i < slab_size; ++i) {
+        new (slab + i) http_conn(conf);
+    }
+    slabs.push_back(slab);
+    //handed out from the front of the slab first
+    for (size_t i(slab_size); i > 0; --i) {
+        free_conns.push_back(slab + i - 1);
+    }
+}
+
+void *conn_pool::get_block(size_t size)
+{
+    pthread_mutex_lock(&mutex);
+    if (!block_size) {
+        block_size = size;
+    }
+    if (size == block_size && !free_blocks.empty()) {
+        auto block = free_blocks.back();
+        free_blocks.pop_back();
+        pthread_mutex_unlock(&mutex);
+        return block;
+    }
+    //room for it to come back
+    if (size == block_size && free_blocks.capacity() <= n_blocks) {
+        try {
+            free_blocks.reserve(2 * n_blocks + 1);
+        }
+        catch (...) {
+            pthread_mutex_unlock(&mutex);
+            throw;
+        }
+    }
+    if (size == block_size) {
+        ++n_blocks;
+    }
+    pthread_mutex_unlock(&mutex);
+    return ::operator new(size);
+}
+
+void conn_pool::put_block(void *block,size_t size)
+{
+    if (size != block_size) {
+        ::operator delete(block);
+        return;
+    }
+    pthread_mutex_lock(&mutex);
+    free_blocks.push_back(block);
+    pthread_mutex_unlock(&mutex);
+}
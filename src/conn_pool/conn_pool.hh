@@ -0,0 +1,80 @@
+#ifndef CONN_POOL_HH
+#define CONN_POOL_HH
+
+#include "http_conn/http_conn.hh"
+
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include <memory>
+#include <vector>
+#include <new>
+#include <stdexcept>
+
+//http_conn objects made by slabs and recycled, so that accepting and closing a connection allocates nothing in steady state
+//an object handed out is owned by shared_ptrs as usual; the last one dropping closes the connection and gives the object back
+//control blocks of those shared_ptrs are recycled as well
+//thread-safe, as the last reference may drop in any thread; the pool must outlive every object handed out
+
+class conn_pool
+{
+public:
+    //objects are made slab_size at a time, closed, as the free ones run out
+    explicit conn_pool(const http_conn::config &conf,size_t slab_size = 64);
+    ~conn_pool();
+    //an object opened for the connection accepted
+    std::shared_ptr<http_conn> acquire(int fd,const sockaddr_in &addr);
+
+    struct stats {
+        size_t made = 0;    //<objects made so far
+        size_t free = 0;    //<objects waiting in the pool
+    };
+    stats get_stats() const;
+
+private:
+    //deleter of the shared_ptrs handed out
+    struct recycler {
+        conn_pool *pool;
+        void operator()(http_conn *conn) const;
+    };
+    //allocator of their control blocks, all of one size
+    template <typename T>
+    struct block_allocator {
+        typedef T value_type;
+        conn_pool *pool;
+        explicit block_allocator(conn_pool *pool) : pool(pool) {}
+        template <typename U>
+        block_allocator(const block_allocator<U> &other) : pool(other.pool) {}
+        T *allocate(size_t n) {
+            return static_cast<T *>(pool->get_block(n * sizeof(T)));
+        }
+        void deallocate(T *p,size_t n) {
+            pool->put_block(p,n * sizeof(T));
+        }
+        template <typename U>
+        bool operator==(const block_allocator<U> &other) const {
+            return pool == other.pool;
+        }
+        template <typename U>
+        bool operator!=(const block_allocator<U> &other) const {
+            return pool != other.pool;
+        }
+    };
+
+    const http_conn::config &conf;
+    size_t slab_size;
+    mutable pthread_mutex_t mutex;
+    std::vector<http_conn *> slabs;
+    //room for every object and block made is reserved, so that giving one back never allocates
+    std::vector<http_conn *> free_conns;
+    std::vector<void *> free_blocks;
+    size_t block_size = 0;  //<size of control blocks, known as the first one is asked for
+    size_t n_blocks = 0;
+
+    //make a slab of objects; with mutex held
+    void grow();
+    void *get_block(size_t size);
+    void put_block(void *block,size_t size);
+};
+
+#endif //CONN_POOL_HH
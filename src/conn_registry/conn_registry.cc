@@ -0,0 +1,31 @@
+#include "conn_registry.hh"
+
+using namespace std;
+
+uint64_t conn_registry::insert(const shared_ptr<http_conn> &conn)
+{
+    auto fd = conn->fd();
+    if (fd >= slots.size()) {
+        //grow geometrically as fds are allocated lowest first
+        slots.resize(max(static_cast<size_t>(fd) + 1,slots.size() * 2));
+    }
+    auto &s = slots[fd];
+    //skip generation 0 on wrap-around
+    if (++s.gen == 0) {
+        s.gen = 1;
+    }
+    s.e.conn = conn;
+    s.e.timer = timer_wheel::npos;
+    ++n_conn;
+    return make_tag(fd,s.gen);
+}
+
+bool conn_registry::erase(uint64_t tag)
+{
+    if (!get(tag)) {
+        return false;
+    }
+    slots[tag_fd(tag)].e.conn.reset();
+    --n_conn;
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef CONN_REGISTRY_HH
+#define CONN_REGISTRY_HH
+
+#include "http_conn/http_conn.hh"
+#include "timer_wheel/timer_wheel.hh"
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+//connections of one reactor in a flat array indexed by fd
+//every slot counts generations, so that an event of a closed connection is told from one of a new connection reusing the fd
+//only the reactor thread owning it touches it, so there's no lock
+
+class conn_registry
+{
+public:
+    struct entry {
+        std::shared_ptr<http_conn> conn;
+        timer_wheel::handle timer = timer_wheel::npos;
+    };
+
+    //tag of a connection, carried by epoll_event.data: generation in the higher 32 bits, fd in the lower
+    //generation starts from 1; tags of generation 0 are for fds other than connections
+    static uint64_t make_tag(int fd,uint32_t gen) {
+        return (static_cast<uint64_t>(gen) << 32) | static_cast<uint32_t>(fd);
+    }
+    static int tag_fd(uint64_t tag) {
+        return static_cast<int>(tag & 0xffffffff);
+    }
+    static uint32_t tag_gen(uint64_t tag) {
+        return static_cast<uint32_t>(tag >> 32);
+    }
+
+    //returns tag of the registered connection
+    uint64_t insert(const std::shared_ptr<http_conn> &conn);
+    //nullptr if the connection of tag has gone
+    entry *get(uint64_t tag) {
+        auto fd = tag_fd(tag);
+        if (fd < 0 || fd >= slots.size() || slots[fd].gen != tag_gen(tag) || !slots[fd].e.conn) {
+            return nullptr;
+        }
+        return &slots[fd].e;
+    }
+    //returns false if tag is stale
+    bool erase(uint64_t tag);
+    size_t size() const {
+        return n_conn;
+    }
+
+private:
+    struct slot {
+        entry e;
+        uint32_t gen = 0;
+    };
+    std::vector<slot> slots;
+    size_t n_conn = 0;
+};
+
+#endif //CONN_REGISTRY_HH
@@ -0,0 +1,138 @@
+#include "cpu_topology.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <algorithm>
+
+using namespace std;
+
+int cpu_topology::node_of(int cpu)
+{
+    auto &l = get();
+    return (cpu >= 0 && cpu < l.cpu_node.size()) ? l.cpu_node[cpu] : -1;
+}
+
+cpu_set_t cpu_topology::cpu_mask(int cpu)
+{
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu,&mask);
+    return mask;
+}
+
+cpu_set_t cpu_topology::node_mask(int node)
+{
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (auto cpu : cpus_of(node)) {
+        CPU_SET(cpu,&mask);
+    }
+    return mask;
+}
+
+bool cpu_topology::pin_self(const cpu_set_t &mask)
+{
+    return pin(pthread_self(),mask);
+}
+
+bool cpu_topology::pin(pthread_t tid,const cpu_set_t &mask)
+{
+    return pthread_setaffinity_np(tid,sizeof(mask),&mask) == 0;
+}
+
+const cpu_topology::layout &cpu_topology::get()
+{
+    //read once; thread-safe as a function local static
+    static const layout l = load();
+    return l;
+}
+
+cpu_topology::layout cpu_topology::load()
+{
+    layout l;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0,sizeof(allowed),&allowed) < 0) {
+        CPU_SET(0,&allowed);
+    }
+    l.cpu_node.assign(CPU_SETSIZE,-1);
+    //nodes may be numbered sparsely; those without an allowed CPU are skipped
+    for (auto node : parse_list(read_line("/sys/devices/system/node/online").c_str())) {
+        vector<int> list;
+        for (auto cpu : parse_list(read_line("/sys/devices/system/node/node" + to_string(node) + "/cpulist").c_str())) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu,&allowed)) {
+                list.push_back(cpu);
+            }
+        }
+        if (!list.empty()) {
+            for (auto cpu : list) {
+                l.cpu_node[cpu] = l.node_cpus.size();
+            }
+            l.node_cpus.push_back(move(list));
+        }
+    }
+    if (l.node_cpus.empty()) {
+        l.node_cpus.emplace_back();
+        for (int cpu(0); cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu,&allowed)) {
+                l.node_cpus[0].push_back(cpu);
+                l.cpu_node[cpu] = 0;
+            }
+        }
+    }
+    size_t longest = 0;
+    for (auto &list : l.node_cpus) {
+        longest = max(longest,list.size());
+    }
+    for (size_t i(0); i < longest; ++i) {
+        for (auto &list : l.node_cpus) {
+            if (i < list.size()) {
+                l.interleaved.push_back(list[i]);
+            }
+        }
+    }
+    return l;
+}
+
+string cpu_topology::read_line(const string &path)
+{
+    char buf[4096] = {};
+    auto f = fopen(path.c_str(),"r");
+    if (f) {
+        if (!fgets(buf,sizeof(buf),f)) {
+            buf[0] = 0;
+        }
+        fclose(f);
+    }
+    return buf;
+}
+
+vector<int> cpu_topology::parse_list(const char *s)
+{
+    vector<int> list;
+    char *end;
+    while (*s) {
+        auto first = strtol(s,&end,10);
+        if (end == s) {
+            break;
+        }
+        auto last = first;
+        s = end;
+        if (*s == '-') {
+            last = strtol(s + 1,&end,10);
+            s = end;
+        }
+        for (auto cpu = first; cpu <= last; ++cpu) {
+            list.push_back(cpu);
+        }
+        if (*s == ',') {
+            ++s;
+        }
+        else {
+            break;
+        }
+    }
+    return list;
+}
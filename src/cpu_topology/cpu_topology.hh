@@ -0,0 +1,50 @@
+#ifndef CPU_TOPOLOGY_HH
+#define CPU_TOPOLOGY_HH
+
+#include <sched.h>
+#include <pthread.h>
+
+#include <vector>
+#include <string>
+
+//CPUs the process may run on and the NUMA nodes they belong to, read from sysfs once
+//a machine without NUMA, or without sysfs, is taken as one node of all allowed CPUs
+
+class cpu_topology
+{
+public:
+    //allowed CPUs, interleaved among nodes: the first ones go to node 0, 1, ..., then around again
+    //so that threads pinned in this order spread over sockets evenly
+    static const std::vector<int> &cpus() {
+        return get().interleaved;
+    }
+    static int nodes() {
+        return get().node_cpus.size();
+    }
+    //-1 if the CPU isn't allowed
+    static int node_of(int cpu);
+    //allowed CPUs of node
+    static const std::vector<int> &cpus_of(int node) {
+        return get().node_cpus[node];
+    }
+    static cpu_set_t cpu_mask(int cpu);
+    static cpu_set_t node_mask(int node);
+    //pin the calling thread; false on failure
+    static bool pin_self(const cpu_set_t &mask);
+    static bool pin(pthread_t tid,const cpu_set_t &mask);
+
+private:
+    struct layout {
+        std::vector<std::vector<int>> node_cpus;
+        std::vector<int> cpu_node;  //<indexed by CPU
+        std::vector<int> interleaved;
+    };
+    static const layout &get();
+    static layout load();
+    //empty if unreadable
+    static std::string read_line(const std::string &path);
+    //"0-3,8,10-11" to a list
+    static std::vector<int> parse_list(const char *s);
+};
+
+#endif //CPU_TOPOLOGY_HH
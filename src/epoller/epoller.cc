@@ -1,11 +1,7 @@
 #include "epoller.hh"
 
-epoller::epoller(size_t max_event) : max_event(max_event)
+epoller::epoller(size_t max_event) : event_backend(max_event)
 {
-    events_ = new epoll_event[max_event];
-    if (!events_) {
-        throw std::runtime_error("new error");
-    }
     int save = errno;
     errno = 0;
     epfd = epoll_create(1);
@@ -16,30 +12,36 @@ epoller::epoller(size_t max_event) : max_event(max_event)
     errno = save;
 }
 
-void epoller::add(int fd,uint32_t e)
+void epoller::add(int fd,uint32_t e,uint64_t data)
 {
-    ctl(fd,EPOLL_CTL_ADD,e);
+    ctl(fd,EPOLL_CTL_ADD,e,data);
 }
 
-void epoller::mod(int fd,uint32_t e)
+void epoller::mod(int fd,uint32_t e,uint64_t data)
 {
-    ctl(fd,EPOLL_CTL_MOD,e);
+    ctl(fd,EPOLL_CTL_MOD,e,data);
 }
 
 void epoller::del(int fd)
 {
-    ctl(fd,EPOLL_CTL_DEL,0);
+    ctl(fd,EPOLL_CTL_DEL,0,0);
 }
 
-void epoller::ctl(int fd,int op,uint32_t events)
+void epoller::ctl(int fd,int op,uint32_t events,uint64_t data)
 {
     epoll_event ev;
     if (op != EPOLL_CTL_DEL) {
-        ev.data.fd = fd;
+        ev.data.u64 = data;
         ev.events = events;
     }
     int save = errno;
     if (epoll_ctl(epfd,op,fd,(op == EPOLL_CTL_DEL) ? nullptr : &ev) == -1) {
+        //deleted by another thread, e.g. when the connection expired during being served
+        if (errno == ENOENT && op != EPOLL_CTL_ADD) {
+            log_debug("epoll_ctl on fd " + std::to_string(fd) + " not registered");
+            errno = save;
+            return;
+        }
         log_err("epoll_ctl error: " + std::string(strerror(errno)));
         throw std::runtime_error("epoll_ctl error: " + std::string(strerror(errno)));
     }
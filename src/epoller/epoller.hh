@@ -1,6 +1,7 @@
 #ifndef EPOLLER_HH
 #define EPOLLER_HH
 
+#include "event_backend/event_backend.hh"
 #include "logger/logger.hh"
 
 #include <unistd.h>
@@ -11,30 +12,27 @@
 #include <string>
 #include <stdexcept>
 
-//this class stores fd into epoll_event.data
+//this class stores the data given by caller into epoll_event.data
 
-class epoller
+class epoller : public event_backend
 {
 public:
     epoller(size_t max_event);
     ~epoller() {
         close(epfd);
-        delete[] events_;
     }
-    void add(int fd,uint32_t e);
-    void mod(int fd,uint32_t e);
-    void del(int fd);
-    size_t wait(int timeout);
-    epoll_event *events() {
-        return events_;
+    void add(int fd,uint32_t e,uint64_t data) override;
+    void mod(int fd,uint32_t e,uint64_t data) override;
+    void del(int fd) override;
+    size_t wait(int timeout) override;
+    const char *name() const override {
+        return "epoll";
     }
 
 private:
     int epfd;
-    epoll_event *events_;
-    size_t max_event;
 
-    void ctl(int fd,int op,uint32_t events);
+    void ctl(int fd,int op,uint32_t events,uint64_t data);
 };
 
-#endif //EPOLLER_HH
\ No newline at end of file
+#endif //EPOLLER_HH
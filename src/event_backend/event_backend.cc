@@ -0,0 +1,11 @@
+#include "event_backend.hh"
+#include "epoller/epoller.hh"
+
+event_backend *event_backend::create(type t,size_t max_event)
+{
+    switch (t) {
+    case EPOLL:
+    default:
+        return new epoller(max_event);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef EVENT_BACKEND_HH
+#define EVENT_BACKEND_HH
+
+#include <sys/epoll.h>
+
+#include <stdexcept>
+
+//interface of the IO multiplexing a reactor waits on
+//readiness is always reported in epoll_event, whatever the backend is
+
+class event_backend
+{
+public:
+    enum type {
+        EPOLL
+    };
+    static event_backend *create(type t,size_t max_event);
+
+    event_backend(size_t max_event) : max_event(max_event) {
+        events_ = new epoll_event[max_event];
+        if (!events_) {
+            throw std::runtime_error("new error");
+        }
+    }
+    virtual ~event_backend() {
+        delete[] events_;
+    }
+    //same meaning as epoll_ctl; e is an epoll event mask
+    //data is reported back in epoll_event.data.u64, and its lower 32 bits must be fd
+    //mod() and del() on an fd not added, or deleted by another thread in the meantime, are ignored
+    virtual void add(int fd,uint32_t e,uint64_t data) = 0;
+    virtual void mod(int fd,uint32_t e,uint64_t data) = 0;
+    virtual void del(int fd) = 0;
+    //returns number of ready events placed in events()
+    virtual size_t wait(int timeout) = 0;
+    virtual const char *name() const = 0;
+    epoll_event *events() {
+        return events_;
+    }
+
+protected:
+    epoll_event *events_;
+    size_t max_event;
+};
+
+#endif //EVENT_BACKEND_HH
@@ -0,0 +1,357 @@
+#include "file_cache.hh"
+#include "http_response/http_response.hh"
+
+using namespace std;
+
+file_cache::entry::~entry()
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (map && munmap(map,st.st_size) != 0) {
+        log_err("unmap failed!");
+    }
+}
+
+file_cache::file_cache(const string &root,size_t capacity,bool use_fd,size_t small_file_limit,size_t memory_cap)
+    : root(root.empty() ? "/" : normalize(root)),   //responses look for files at "/name" then
+    shard_capacity(max(capacity / nshard,static_cast<size_t>(1))),
+    use_fd(use_fd),
+    small_file_limit(small_file_limit),
+    shard_memory_cap(memory_cap / nshard)
+{
+    for (auto &s : shards) {
+        if (pthread_mutex_init(&s.mutex,nullptr) < 0) {
+            throw runtime_error("pthread_mutex_init error");
+        }
+    }
+    if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        log_err("inotify_init1 failed");
+        throw runtime_error("inotify_init1 error");
+    }
+    if ((wakeup_fd = eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        log_err("eventfd failed");
+        throw runtime_error("eventfd error");
+    }
+    watch_tree(this->root);
+    //dedicate a thread to inotify events, joined on destruction
+    if (pthread_create(&watcher,nullptr,watcher_thrd_fn,this) < 0) {
+        throw runtime_error("pthread_create error");
+    }
+}
+
+file_cache::~file_cache()
+{
+    //closing inotify_fd wouldn't wake up a thread blocked on it; the shards must stay until the watcher has returned
+    uint64_t one = 1;
+    if (write(wakeup_fd,&one,sizeof(one)) < 0) {
+        log_err("file cache watcher wakeup failed");
+    }
+    pthread_join(watcher,nullptr);
+    close(wakeup_fd);
+    close(inotify_fd);
+    clear();
+    for (auto &s : shards) {
+        pthread_mutex_destroy(&s.mutex);
+    }
+}
+
+shared_ptr<const file_cache::entry> file_cache::get(string_view path)
+{
+    //every thread normalizes into a key of its own, reused by its lookups
+    thread_local string key;
+    normalize(path,key);
+    //never serve anything out of root
+    if (!under_root(key)) {
+        return none();
+    }
+    auto &s = shard_of(key);
+    pthread_mutex_lock(&s.mutex);
+    auto it = s.index.find(key);
+    if (it != s.index.end()) {
+        //move to front
+        s.lru.splice(s.lru.begin(),s.lru,it->second);
+        auto e = it->second->second;
+        pthread_mutex_unlock(&s.mutex);
+        n_hit.fetch_add(1,memory_order_relaxed);
+        return e;
+    }
+    auto gen = s.gen;
+    pthread_mutex_unlock(&s.mutex);
+    n_miss.fetch_add(1,memory_order_relaxed);
+
+    //load without the lock; a concurrent miss of the same path may load it too, and the first one inserted wins
+    auto e = load(key);
+
+    pthread_mutex_lock(&s.mutex);
+    if (s.gen != gen) {
+        //invalidated meanwhile; what was loaded may be outdated already, so serve it this once only
+        pthread_mutex_unlock(&s.mutex);
+        return e;
+    }
+    it = s.index.find(key);
+    if (it != s.index.end()) {
+        e = it->second->second;
+    }
+    else {
+        s.lru.emplace_front(key,e);
+        s.index[key] = s.lru.begin();
+        s.bytes += e->response.size();
+        evict(s);
+    }
+    pthread_mutex_unlock(&s.mutex);
+    return e;
+}
+
+shared_ptr<const file_cache::entry> file_cache::peek(string_view path)
+{
+    thread_local string key;
+    normalize(path,key);
+    if (!under_root(key)) {
+        return none();
+    }
+    auto &s = shard_of(key);
+    shared_ptr<const entry> e;
+    pthread_mutex_lock(&s.mutex);
+    auto it = s.index.find(key);
+    if (it != s.index.end()) {
+        e = it->second->second;
+    }
+    pthread_mutex_unlock(&s.mutex);
+    return e;
+}
+
+void file_cache::invalidate(const string &path)
+{
+    auto &s = shard_of(path);
+    pthread_mutex_lock(&s.mutex);
+    ++s.gen;
+    auto it = s.index.find(path);
+    if (it != s.index.end()) {
+        erase(s,it->second);
+    }
+    pthread_mutex_unlock(&s.mutex);
+}
+
+void file_cache::evict(shard &s)
+{
+    //the entry just inserted stays even if it's too large by itself; it's served once and goes next time
+    while (s.lru.size() > 1 && (s.lru.size() > shard_capacity || s.bytes > shard_memory_cap)) {
+        erase(s,prev(s.lru.end()));
+    }
+}
+
+void file_cache::erase(shard &s,lru_list::iterator it)
+{
+    s.bytes -= it->second->response.size();
+    s.index.erase(it->first);
+    s.lru.erase(it);
+}
+
+size_t file_cache::memory() const
+{
+    size_t bytes = 0;
+    for (auto &s : shards) {
+        pthread_mutex_lock(const_cast<pthread_mutex_t *>(&s.mutex));
+        bytes += s.bytes;
+        pthread_mutex_unlock(const_cast<pthread_mutex_t *>(&s.mutex));
+    }
+    return bytes;
+}
+
+void file_cache::clear()
+{
+    for (auto &s : shards) {
+        pthread_mutex_lock(&s.mutex);
+        ++s.gen;
+        s.index.clear();
+        s.lru.clear();
+        s.bytes = 0;
+        pthread_mutex_unlock(&s.mutex);
+    }
+}
+
+shared_ptr<const file_cache::entry> file_cache::load(const string &path)
+{
+    auto e = make_shared<entry>();
+    if (stat(path.c_str(),&e->st) < 0 || !S_ISREG(e->st.st_mode)) {
+        return e;
+    }
+    int fd = open(path.c_str(),O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        log_err("response file open error");
+        return e;
+    }
+    e->found = true;
+    e->type = http_response::file_type(path);
+    e->header = "Content-type: " + e->type + "\r\nContent-Length: " + to_string(e->st.st_size) + "\r\n";
+    //small enough to be served from memory
+    if (e->st.st_size <= small_file_limit && e->st.st_size <= shard_memory_cap) {
+        e->response = e->header + "\r\n";
+        auto off = e->response.size();
+        e->response.resize(off + e->st.st_size);
+        size_t got = 0;
+        ssize_t len;
+        while (got < e->st.st_size && (len = pread(fd,&e->response[off + got],e->st.st_size - got,got)) > 0) {
+            got += len;
+        }
+        close(fd);
+        //changed while being read; let the next request try again
+        if (got != e->st.st_size) {
+            log_err("response file read error");
+            e->found = false;
+        }
+        return e;
+    }
+    if (use_fd) {
+        e->fd = fd;
+    }
+    else {
+        //an empty file can't be mapped, and has nothing to map anyway
+        if (e->st.st_size > 0 && (e->map = static_cast<char *>(mmap(0,e->st.st_size,PROT_READ,MAP_PRIVATE,fd,0))) == MAP_FAILED) {
+            e->map = nullptr;
+            close(fd);
+            log_err("file map failed");
+            return e;
+        }
+        close(fd);
+    }
+    return e;
+}
+
+void file_cache::watch_tree(const string &dir)
+{
+    static const uint32_t mask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+    //nftw() takes no argument for the callback
+    static thread_local file_cache *self;
+    self = this;
+    auto fn = [](const char *fpath,const struct stat *sb,int typeflag,struct FTW *ftwbuf) {
+        if (typeflag == FTW_D) {
+            int wd = inotify_add_watch(self->inotify_fd,fpath,mask);
+            if (wd < 0) {
+                log_err("inotify_add_watch failed on " + string(fpath));
+            }
+            else {
+                self->watches[wd] = fpath;
+            }
+        }
+        return 0;
+    };
+    if (nftw(dir.c_str(),fn,16,FTW_PHYS) < 0) {
+        log_err("failed to watch " + dir);
+    }
+}
+
+void file_cache::watch_events()
+{
+    //enough for a batch of events
+    alignas(inotify_event) char buf[64 * (sizeof(inotify_event) + NAME_MAX + 1)];
+    pollfd fds[2] = {{inotify_fd,POLLIN,0},{wakeup_fd,POLLIN,0}};
+    while (true) {
+        if (poll(fds,2,-1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_err("file cache watcher poll failed");
+            return;
+        }
+        //being destroyed
+        if (fds[1].revents) {
+            return;
+        }
+        auto len = read(inotify_fd,buf,sizeof(buf));
+        if (len < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            log_err("inotify read failed");
+            return;
+        }
+        for (char *p = buf; p < buf + len; p += sizeof(inotify_event) + reinterpret_cast<inotify_event *>(p)->len) {
+            auto ev = reinterpret_cast<inotify_event *>(p);
+            //events lost; anything may have changed
+            if (ev->mask & IN_Q_OVERFLOW) {
+                log_warn("inotify queue overflowed, file cache cleared");
+                clear();
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                watches.erase(ev->wd);
+                continue;
+            }
+            auto it = watches.find(ev->wd);
+            if (it == watches.end()) {
+                continue;
+            }
+            //a directory changing drops every path under it, which can't be told from the key alone
+            if ((ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) || (ev->mask & IN_ISDIR)) {
+                if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)) && ev->len) {
+                    watch_tree(it->second + "/" + ev->name);
+                }
+                clear();
+                continue;
+            }
+            if (ev->len) {
+                invalidate(normalize(it->second + "/" + ev->name));
+            }
+        }
+    }
+}
+
+bool file_cache::under_root(const string &key) const
+{
+    //the current directory holds every relative path not climbing out of it
+    if (root == ".") {
+        return key[0] != '/' && key != ".." && key.compare(0,3,"../") != 0;
+    }
+    return key.compare(0,root.size(),root) == 0 && (key.size() == root.size() || root.back() == '/' || key[root.size()] == '/');
+}
+
+void *file_cache::watcher_thrd_fn(void *arg)
+{
+    static_cast<file_cache *>(arg)->watch_events();
+    return nullptr;
+}
+
+void file_cache::normalize(string_view path,string &out)
+{
+    out.clear();
+    //a relative path stays relative, to the same directory
+    bool absolute = !path.empty() && path[0] == '/';
+    if (absolute) {
+        out.push_back('/');
+    }
+    //where the parts that ".." may drop begin; leading ".." of a relative path are kept
+    size_t base = out.size();
+    size_t i = 0;
+    while (i < path.size()) {
+        auto j = path.find('/',i);
+        if (j == string_view::npos) {
+            j = path.size();
+        }
+        auto part = path.substr(i,j - i);
+        if (part == "..") {
+            if (out.size() > base) {
+                auto k = out.rfind('/');
+                out.resize(k == string::npos || k < base ? base : k);
+            }
+            else if (!absolute) {
+                if (!out.empty()) {
+                    out.push_back('/');
+                }
+                out.append("..");
+                base = out.size();
+            }
+        }
+        else if (!part.empty() && part != ".") {
+            if (out.size() > (absolute ? 1 : 0)) {
+                out.push_back('/');
+            }
+            out.append(part.data(),part.size());
+        }
+        i = j + 1;
+    }
+    if (out.empty()) {
+        out.push_back('.');
+    }
+}
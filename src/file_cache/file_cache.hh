@@ -0,0 +1,126 @@
+#ifndef FILE_CACHE_HH
+#define FILE_CACHE_HH
+
+#include "logger/logger.hh"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <ftw.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+
+#include <string>
+#include <string_view>
+#include <list>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+
+//files under the document root, opened once and shared by all responses
+//an entry holds the stat result, the open fd or the mapping, and the header lines describing the file
+//small files are read into memory instead, together with their header lines, so that a hit is one writev() with nothing to open
+//entries are dropped on inotify events of the document root rather than checked on every hit
+//sharded LRU, one lock per shard; thread-safe
+
+class file_cache
+{
+public:
+    struct entry {
+        bool found = false; //<false if not a regular file that can be opened; cached as well
+        struct stat st;
+        int fd = -1;    //<if opened for sendfile()
+        char *map = nullptr;    //<if mapped
+        std::string type;   //<MIME type
+        std::string header; //<Content-type and Content-Length lines
+        std::string response;   //<header, blank line and content, if small enough to keep in memory; then neither fd nor map is kept
+        entry() = default;
+        entry(const entry &) = delete;
+        entry &operator=(const entry &) = delete;
+        ~entry();
+    };
+
+    //capacity is the number of entries; files are opened for sendfile() if use_fd, otherwise mapped
+    //files no larger than small_file_limit are kept in memory, taking memory_cap bytes at most
+    file_cache(const std::string &root,size_t capacity,bool use_fd,size_t small_file_limit,size_t memory_cap);
+    ~file_cache();
+    //entry of path, which is under root; a hit allocates nothing
+    std::shared_ptr<const entry> get(std::string_view path);
+    //entry of path if cached already, without loading it on a miss, which returns null instead
+    //for telling whether get() would touch the file system; neither counted nor moving the entry in LRU
+    std::shared_ptr<const entry> peek(std::string_view path);
+    //drop the entry of path, if any
+    void invalidate(const std::string &path);
+    void clear();
+    size_t hits() const {
+        return n_hit.load(std::memory_order_relaxed);
+    }
+    size_t misses() const {
+        return n_miss.load(std::memory_order_relaxed);
+    }
+    //bytes of files kept in memory
+    size_t memory() const;
+
+private:
+    using lru_list = std::list<std::pair<std::string,std::shared_ptr<const entry>>>;
+    struct shard {
+        pthread_mutex_t mutex;
+        lru_list lru;   //<most recently used first
+        std::unordered_map<std::string,lru_list::iterator> index;
+        //changed by every invalidation, so that a miss racing one doesn't put a stale entry back
+        uint64_t gen = 0;
+        size_t bytes = 0;   //<of responses kept in memory
+    };
+    static const size_t nshard = 16;
+
+    std::string root;
+    size_t shard_capacity;
+    bool use_fd;
+    size_t small_file_limit;
+    size_t shard_memory_cap;
+    std::atomic<size_t> n_hit{0};
+    std::atomic<size_t> n_miss{0};
+    shard shards[nshard];
+    //inotify
+    int inotify_fd;
+    pthread_t watcher;
+    int wakeup_fd;  //<wakes the watcher thread up to return, on destruction
+    std::unordered_map<int,std::string> watches;    //<wd to directory; used by the watcher thread only after construction
+
+    //what paths out of root get
+    static const std::shared_ptr<const entry> &none() {
+        static const std::shared_ptr<const entry> e = std::make_shared<entry>();
+        return e;
+    }
+    shard &shard_of(const std::string &path) {
+        return shards[std::hash<std::string>()(path) % nshard];
+    }
+    //stat and open, map or read path
+    std::shared_ptr<const entry> load(const std::string &path);
+    //drop least recently used entries until s is within its limits; must be called with s.mutex held
+    void evict(shard &s);
+    //drop the entry of it; must be called with s.mutex held
+    void erase(shard &s,lru_list::iterator it);
+    //watch dir and every directory under it
+    void watch_tree(const std::string &dir);
+    void watch_events();
+    static void *watcher_thrd_fn(void *arg);
+    //whether key, normalized, is root or under it
+    bool under_root(const std::string &key) const;
+    //collapse "//", "/./" and "/../" of path into out, whose room is reused
+    //a relative path stays relative, and "." if nothing is left of it
+    static void normalize(std::string_view path,std::string &out);
+    static std::string normalize(std::string_view path) {
+        std::string out;
+        normalize(path,out);
+        return out;
+    }
+};
+
+#endif //FILE_CACHE_HH
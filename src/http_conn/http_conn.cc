@@ -5,15 +5,28 @@ using namespace std;
 size_t http_conn::n_conn = 0;
 pthread_mutex_t http_conn::mutex = PTHREAD_MUTEX_INITIALIZER;
 
-http_conn::http_conn(int fd,const sockaddr_in &client_addr,std::string root,const std::set<std::string> &index_pages)
-    : _fd(fd),
-    client_addr(client_addr),
-    root(root),
-    index_pages(index_pages)
+http_conn::http_conn(const config &conf)
+    : conf(conf)
 {
+}
+
+void http_conn::open(int fd,const sockaddr_in &client_addr)
+{
+    _fd = fd;
+    this->client_addr = client_addr;
+    _tag = 0;
+    touch(IDLE);
     incr_conn();
 }
 
+void http_conn::close()
+{
+    detach();
+    ::close(_fd);
+    _fd = -1;
+    decr_conn();
+}
+
 void http_conn::incr_conn()
 {
     pthread_mutex_lock(&mutex);
@@ -43,69 +56,207 @@ bool http_conn::get_trigger()
 
 http_conn::~http_conn()
 {
-    close(_fd);
-    decr_conn();
+    if (is_open()) {
+        close();
+    }
 }
 
 ssize_t http_conn::read()
 {
     ssize_t len;
+    bool got = false;
     do {
-        len = rw_buf.read_fd(fd());
+        len = rbuf.read_fd(fd());
+        got = got || len > 0;
+        //more than a batch of the largest requests is nothing a client is waiting on
+        if (rbuf.len() > max_read_buffer) {
+            log_warn(str_ipport(client_addr) + " sent more than " + std::to_string(max_read_buffer) + " bytes not served yet");
+            errno = EMSGSIZE;
+            len = -1;
+            break;
+        }
     } while (len > 0 && ET);    //when in ET, read all or until interrupted
+    //the first byte starts the header deadline, which later bytes don't extend
+    if (got && phase() == IDLE) {
+        enter(HEADER);
+    }
+    else if (got && phase() == BODY) {
+        touch(BODY);
+    }
     //debug log
-    rw_buf.base()[rw_buf.len()] = 0;
-    log_debug("received from " + str_ipport(client_addr) + ":\n" + rw_buf.base());
+    if (log_enabled(DEBUG) && rbuf.writable()) {
+        rbuf.base()[rbuf.len()] = 0;
+        log_debug("received from " + str_ipport(client_addr) + ":\n" + rbuf.base());
+    }
     return len;
 }
 
-bool http_conn::ready_for_write()
+void http_conn::attach()
 {
-    auto state = request.parse(rw_buf);
-    if (state == request.FINISH || state == request.SYNTAX_ERROR) {
-        http_persistent = request.persistent();
-        return true;
+    size_t size = sizeof(exchange);
+    ex = new (buffer_pool::get(size)) exchange;
+}
+
+void http_conn::detach()
+{
+    if (ex) {
+        ex->~exchange();
+        buffer_pool::put(reinterpret_cast<char *>(ex),sizeof(exchange));
+        ex = nullptr;
     }
-    return false;
+    rbuf.release();
+    wbuf.release();
 }
 
-ssize_t http_conn::write()
+bool http_conn::ready_for_write(bool cached_only)
 {
-    //generate response using request
-    if (index_pages.empty()) {
-        response.init(request,rw_buf,root);
+    missed = false;
+    if (!ex) {
+        if (!rbuf.readable()) {
+            return false;
+        }
+        attach();
     }
-    else {
-        response.init(request,rw_buf,root,index_pages);
+    //status line and header lines of response i is heads[i] of wbuf
+    std::pair<size_t,size_t> heads[max_pipeline];
+    size_t n(0);
+    auto state = ex->request.parse_state();
+    http_persistent = true;
+    //nothing after a request closing the connection, or one that can't be parsed, is answered
+    while (n < max_pipeline && http_persistent) {
+        state = ex->request.parse(rbuf);
+        if (state != ex->request.FINISH && state != ex->request.SYNTAX_ERROR) {
+            break;
+        }
+        if (cached_only && !(conf.index_pages.empty() ? ex->responses[n].cached_only(ex->request,ex->mem,conf.root) : ex->responses[n].cached_only(ex->request,ex->mem,conf.root,conf.index_pages))) {
+            missed = true;
+            break;
+        }
+        http_persistent = ex->request.persistent();
+        //generate response using request
+        auto begin = wbuf.len();
+        if (conf.index_pages.empty()) {
+            ex->responses[n].init(ex->request,wbuf,ex->mem,conf.root);
+        }
+        else {
+            ex->responses[n].init(ex->request,wbuf,ex->mem,conf.root,conf.index_pages);
+        }
+        heads[n++] = {begin,wbuf.len() - begin};
+        //the response has taken all it needs from the request
+        if (state == ex->request.FINISH) {
+            rbuf.retrieved(ex->request.consumed());
+        }
+        else {
+            rbuf.clear();
+        }
+        ex->request.reset();
+    }
+    //a request left partly received would otherwise keep the buffer growing as long as requests keep coming behind it
+    rbuf.compact();
+    if (n == 0) {
+        if (missed) {
+            return false;
+        }
+        if (state == ex->request.BODY) {
+            enter(BODY);
+        }
+        else if (state != ex->request.REQUEST_LINE || rbuf.readable()) {
+            enter(HEADER);
+        }
+        //nothing in flight
+        else {
+            detach();
+        }
+        return false;
+    }
+    //wbuf stays where it is from now on
+    ex->n_seg = ex->cur_seg = 0;
+    ex->out_left = 0;
+    for (size_t i(0); i < n; ++i) {
+        ex->segs[ex->n_seg++] = {wbuf.base() + heads[i].first,heads[i].second,-1,0};
+        auto body = ex->responses[i].body();
+        if (ex->responses[i].body_fd() >= 0 && body.second) {
+            ex->segs[ex->n_seg++] = {nullptr,body.second,ex->responses[i].body_fd(),0};
+        }
+        else if (body.second) {
+            ex->segs[ex->n_seg++] = {body.first,body.second,-1,0};
+        }
+        ex->out_left += heads[i].second + body.second;
     }
-    //get generated status line and header lines
-    iov[0].iov_base = rw_buf.base();
-    iov[0].iov_len = rw_buf.len();
-    //get body
-    auto body = response.body();
-    iov[1].iov_base = body.first;
-    iov[1].iov_len = body.second;
     //log
-    rw_buf.base()[rw_buf.len()] = 0;
-    log_debug("response generated for " + str_ipport(client_addr) + ":\n" + rw_buf.base() + (body.first ? body.first : ""));
-    //write
+    if (log_enabled(DEBUG) && wbuf.writable()) {
+        wbuf.base()[wbuf.len()] = 0;
+        log_debug(to_string(n) + " response(s) generated for " + str_ipport(client_addr) + ":\n" + wbuf.base());
+    }
+    enter(WRITE);
+    return true;
+}
+
+ssize_t http_conn::write()
+{
     ssize_t len;
+    bool more;
     do {
-        len = writev(fd(),iov,2);
-        //update iovec len
-        if (len > iov[0].iov_len) { //iov[0].iov_len must be greater than 0 after subtraction
-            len -= iov[0].iov_len;
-            iov[0].iov_len = 0;
-            iov[1].iov_len -= len;
-            iov[1].iov_base = static_cast<char *>(iov[1].iov_base) + len;
-        }
-        else if (len > 0) {
-            iov[0].iov_len -= len;
-            iov[0].iov_base = static_cast<char *>(iov[0].iov_base) + len;
-        }
-        else {  //len == 0 or len < 0
+        more = ET;  //when in ET, write all or until interrupted
+        if (!to_write()) {
+            return 0;
+        }
+        auto &seg = ex->segs[ex->cur_seg];
+        if (seg.fd >= 0) {
+            len = sendfile(fd(),seg.fd,&seg.file_off,seg.len);
+            if (len > 0) {
+                consumed(len);
+                continue;
+            }
+            //the file shrank since Content-Length was set, so the only way out is closing
+            if (len == 0) {
+                log_err("response file of " + str_ipport(client_addr) + " truncated");
+                ex->out_left = 0;
+                http_persistent = false;
+            }
             break;
         }
-    } while (ET);    //when in ET, write all or until interrupted
-    return len;
-}
\ No newline at end of file
+        //bytes in memory up to the next file
+        struct iovec iov[2 * max_pipeline];
+        size_t n(0);
+        auto i = ex->cur_seg;
+        for (; i < ex->n_seg && ex->segs[i].fd < 0; ++i, ++n) {
+            iov[n].iov_base = const_cast<char *>(ex->segs[i].mem);
+            iov[n].iov_len = ex->segs[i].len;
+        }
+        msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+        //hold the bytes back for the file following, so that they don't go in a segment of their own
+        bool file_next = i < ex->n_seg;
+        len = sendmsg(fd(),&msg,file_next ? MSG_MORE : 0);
+        if (len <= 0) {
+            break;
+        }
+        consumed(len);
+        //the file follows at once, even in LT
+        if (file_next && ex->cur_seg == i) {
+            more = true;
+        }
+    } while (more);
+    return ex->out_left ? len : 0;
+}
+
+void http_conn::consumed(size_t len)
+{
+    touch(WRITE);
+    ex->out_left -= len;
+    while (len) {
+        auto &seg = ex->segs[ex->cur_seg];
+        auto n = std::min(len,seg.len);
+        //sendfile() moves file_off itself
+        if (seg.fd < 0) {
+            seg.mem += n;
+        }
+        seg.len -= n;
+        len -= n;
+        if (!seg.len) {
+            ++ex->cur_seg;
+        }
+    }
+}
@@ -6,14 +6,20 @@
 #include "http_response/http_response.hh"
 #include "logger/logger.hh"
 #include "scalable_buffer/scalable_buffer.hh"
+#include "arena/arena.hh"
 
 #include <pthread.h>
+#include <time.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <arpa/inet.h>
 
 #include <string>
 #include <unordered_set>
 #include <stdexcept>
+#include <atomic>
+#include <algorithm>
 
 //debug
 // #define DBG_MACRO_DISABLE
@@ -22,25 +28,88 @@
 class http_conn
 {
 public:
-    http_conn(int fd,const sockaddr_in &client_addr,std::string root,const std::set<std::string> &index_pages);
-    http_conn(int fd,const sockaddr_in &client_addr,std::string root,std::set<std::string> &&index_pages) : http_conn(fd,client_addr,root,index_pages) {}
-    http_conn(int fd,const sockaddr_in &client_addr,std::string root) : http_conn(fd,client_addr,root,{}) {}
+    //what the connection is waiting for, which decides the timeout applied
+    enum conn_phase {
+        IDLE,   //<keep-alive, between requests
+        HEADER, //<request line and headers
+        BODY,   //<request body
+        WRITE   //<response
+    };
+    //what connections of a server serve by; shared by all of them and never changed once the server starts
+    struct config {
+        std::string root;
+        std::set<std::string> index_pages;  //<default index pages of http_response if empty
+    };
+    //made closed, to be opened for connections accepted one after another
+    explicit http_conn(const config &conf);
+    http_conn(int fd,const sockaddr_in &client_addr,const config &conf) : http_conn(conf) {
+        open(fd,client_addr);
+    }
     ~http_conn();
+    //take a connection accepted; must be closed
+    void open(int fd,const sockaddr_in &client_addr);
+    //close the socket and give back what requests took, leaving the object to be opened again
+    void close();
+    bool is_open() const {
+        return _fd >= 0;
+    }
     //statically set trigger mode
     static void set_trigger(bool ET);
     static bool get_trigger();
     //read from fd once or multiple times depending on ET, returns the result of last scalable_buffer::read_fd()
+    //or -1 with errno EMSGSIZE once more than max_read_buffer bytes wait to be served
     ssize_t read();
-    //check whether request received is ready for generating response
-    bool ready_for_write();
-    //write to fd once or multiple times depending on ET, returns the result of last writev()
+    //parse every complete request received, max_pipeline at most, and generate their responses in order
+    //returns false if there's no complete request yet
+    //with cached_only, stops before a response that would touch the file system, which is left parsed for the next call
+    //if it's the first of the batch, returns false and cache_missed() tells
+    bool ready_for_write(bool cached_only = false);
+    bool cache_missed() const {
+        return missed;
+    }
+    //bytes of the responses generated not written yet
+    size_t to_write() const {
+        return ex ? ex->out_left : 0;
+    }
+    //write to fd once or multiple times depending on ET
+    //responses go out together, one sendmsg() for all the bytes in memory up to a file body, which is sent by sendfile()
+    //a file body is tried right after the bytes ahead of it are written, even in LT
+    //returns 0 if all the responses are written, otherwise the result of last sendmsg() or sendfile()
     ssize_t write();
-    //reset for next HTTP request
+    //reset for next batch of requests; requests received but not parsed yet are kept
+    //whatever the batch built in the arena goes at once
     void reset() {
-        request.reset();
-        rw_buf.clear();
+        wbuf.clear();
+        if (ex) {
+            ex->n_seg = ex->cur_seg = 0;
+            ex->out_left = 0;
+            ex->mem.reset();
+        }
+        enter(IDLE);
+    }
+    //may be read by threads other than the one serving the connection
+    conn_phase phase() const {
+        return static_cast<conn_phase>(state.load(std::memory_order_relaxed) >> 32);
+    }
+    //when the timeout of the phase counts from, by now_ms(): entering it for headers and idle
+    //and the last progress for a body or a response, so that the reactor works deadlines out only as its timers fire
+    //read together with the phase, so that one is never seen with the other of another phase
+    std::pair<conn_phase,uint32_t> phase_since() const {
+        auto st = state.load(std::memory_order_relaxed);
+        return {static_cast<conn_phase>(st >> 32),static_cast<uint32_t>(st)};
+    }
+    //ms of a coarse monotonic clock, wrapping around; only differences make sense
+    static uint32_t now_ms() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE,&ts);
+        return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
     }
-    //tell if connection is persistent
+    //most requests answered in one batch
+    static const size_t max_pipeline = 16;
+    //bytes received and not answered yet, beyond which the connection is closed
+    static const size_t max_read_buffer = 1 << 20;
+
+    //tell if connection is persistent, i.e. the last request of the batch is
     //must be called after ready_for_write returns true
     bool persistent() const {
         return http_persistent;
@@ -51,6 +120,13 @@ public:
     sockaddr_in addr() const {
         return client_addr;
     }
+    //registry tag; the epoll_event.data of this connection
+    uint64_t tag() const {
+        return _tag;
+    }
+    void set_tag(uint64_t tag) {
+        _tag = tag;
+    }
 
     //not using lock; just a hint
     static size_t conn_count() {
@@ -58,15 +134,52 @@ public:
     }
 
 private:
-    int _fd;
+    const config &conf;
+    int _fd = -1;
+    uint64_t _tag;
     sockaddr_in client_addr;
-    http_request request;
-    http_response response;
     bool http_persistent;
-    scalable_buffer rw_buf{4096};   //<4KB initial size, as big as one page on most machines
-    struct iovec iov[2];
-    std::string root;
-    std::set<std::string> index_pages;
+    bool missed = false;
+    //phase in the higher 32 bits, since in the lower; written by the thread serving the connection only
+    std::atomic<uint64_t> state{0};
+    //both take memory as bytes come in or go out, and give it back as the connection goes idle
+    scalable_buffer rbuf{0};
+    scalable_buffer wbuf{0};    //<status lines and header lines of a batch
+    //a piece of output: bytes in memory, or a part of a file if fd is not -1
+    struct segment {
+        const char *mem;
+        size_t len;
+        int fd;
+        off_t file_off;
+    };
+    //what requests in flight take, which an idle keep-alive connection does without
+    //from buffer_pool, as bytes of a request come in, and back as the connection goes idle
+    struct exchange {
+        http_request request;
+        http_response responses[max_pipeline];  //<files of the last batch are held until then
+        segment segs[2 * max_pipeline];
+        size_t n_seg = 0;
+        size_t cur_seg = 0; //<first segment not written completely
+        size_t out_left = 0;
+        arena mem;  //<what the batch builds besides status lines and header lines
+    };
+    exchange *ex = nullptr;
+
+    void attach();
+    //back to the least an idle connection takes
+    void detach();
+    //count len bytes written off the segments
+    void consumed(size_t len);
+    //move to phase, whose timeout counts from now on; nothing if in it already
+    void enter(conn_phase phase) {
+        if (phase != this->phase()) {
+            touch(phase);
+        }
+    }
+    //progress in phase
+    void touch(conn_phase phase) {
+        state.store(static_cast<uint64_t>(phase) << 32 | now_ms(),std::memory_order_relaxed);
+    }
 
     static bool ET;
     static size_t n_conn;
@@ -2,8 +2,6 @@
 
 using namespace std;
 
-const char *http_request::eol = "\r\n";
-
 http_request::http_request()
 {
     reset();
@@ -15,8 +13,14 @@ http_request::~http_request()
 
 void http_request::reset()
 {
-    http_headers.clear();
     state = REQUEST_LINE;
+    src = nullptr;
+    pos = scan = 0;
+    http_method = http_path = http_params = http_version = http_body = span();
+    n_header = 0;
+    content_len = 0;
+    http_persistent = false;
+    http_code = 400;
 }
 
 //usage:
@@ -27,37 +31,49 @@ void http_request::reset()
 //auto [base,len] = res.non_body();
 //write base into fd
 
-http_request::http_parse_state http_request::parse(scalable_buffer &buf)
+http_request::http_parse_state http_request::parse(const scalable_buffer &buf)
 {
-    while (buf.readable() && state != FINISH) {
-        auto end = search(buf.base(), buf.base() + buf.readable(), eol, eol + 2);
-        std::string line(buf.base(), end);
-        dbg(line,end - buf.base(),buf.readable());
-        switch(state) {
-            case REQUEST_LINE:
-                if(!parse_request_line(line)) {
-                    http_code = 400;
-                    return SYNTAX_ERROR;   //syntax error
-                }
-                break;    
-            case HEADERS:
-                parse_headers(line);
-                if(buf.readable() <= 2) {
-                    state = FINISH;
+    src = &buf;
+    auto base = buf.base();
+    auto len = buf.readable();
+    while (state == REQUEST_LINE || state == HEADERS) {
+        auto end = find_eol(base,len);
+        //eol not encountered; need to read more, unless it's never going to end
+        if (end == string::npos) {
+            return (len > max_head_size) ? fail() : state;
+        }
+        if (end > max_head_size) {
+            return fail();
+        }
+        if (state == REQUEST_LINE) {
+            //empty lines ahead of a request line are ignored
+            if (end != pos) {
+                if (!parse_request_line(base,pos,end)) {
+                    return fail();
                 }
-                break;
-            case BODY:
-                parse_body(line);
-                break;
-            default:
-                break;
+                state = HEADERS;
+            }
+        }
+        //blank line ending header lines
+        else if (end == pos) {
+            if (!end_headers()) {
+                return fail();
+            }
+            state = content_len ? BODY : FINISH;
         }
-        //eol not encountered; need to read more
-        if(end == buf.base() + buf.readable()) {
-            break;
+        else if (!parse_header(base,pos,end)) {
+            return fail();
         }
         //point to the next line
-        buf.retrieved(end - buf.base() + 2);
+        pos = scan = end + 2;
+    }
+    if (state == BODY) {
+        if (len - pos < content_len) {
+            return state;
+        }
+        http_body = {pos,content_len};
+        pos += content_len;
+        state = FINISH;
     }
     if (state == FINISH) {
         http_code = 200;
@@ -65,41 +81,111 @@ http_request::http_parse_state http_request::parse(scalable_buffer &buf)
     return state;
 }
 
-bool http_request::parse_request_line(const std::string& line)
+string_view http_request::header(string_view name) const
 {
-    regex patten("^([^ ]*) /([^ ?]*)(\\?[^ ]+)? HTTP/([^ ]*)$");
-    smatch subMatch;
-    if(!regex_match(line, subMatch, patten)) {           
+    for (size_t i(0); i < n_header; ++i) {
+        if (iequals(view(headers[i].name),name)) {
+            return view(headers[i].value);
+        }
+    }
+    return string_view();
+}
+
+size_t http_request::find_eol(const char *base,size_t len)
+{
+    auto i = scan + simd_scan::find_crlf(base + scan,len - scan);
+    if (i < len) {
+        return i;
+    }
+    //bytes scanned needn't be scanned again, except a '\r' at the end
+    if (len && len - 1 > scan) {
+        scan = len - 1;
+    }
+    return string::npos;
+}
+
+bool http_request::parse_request_line(const char *base,size_t begin,size_t end)
+{
+    //method SP /path[?params] SP HTTP/version
+    string_view line(base + begin,end - begin);
+    auto n = line.size();
+    auto sp1 = simd_scan::find_of(line.data(),n,' ',' ');
+    if (sp1 == 0 || sp1 + 1 >= n || line[sp1 + 1] != '/') {
         return false;
     }
-    http_method = subMatch.str(1);
-    http_path = subMatch.str(2);
-    http_params = subMatch.str(3);
-    http_version = subMatch.str(4);
+    //path ends at '?' or ' '; params, if any, end at ' '
+    auto q = sp1 + 2 + simd_scan::find_of(line.data() + sp1 + 2,n - sp1 - 2,' ','?');
+    auto sp2 = q;
+    if (q < n && line[q] == '?') {
+        sp2 = q + simd_scan::find_of(line.data() + q,n - q,' ',' ');
+    }
+    if (sp2 >= n) {
+        return false;
+    }
+    auto ver = line.substr(sp2 + 1);
+    if (ver.substr(0,5) != "HTTP/" || simd_scan::find_of(ver.data(),ver.size(),' ',' ') != ver.size()) {
+        return false;
+    }
+    http_method = {begin,sp1};
+    http_path = {begin + sp1 + 2,q - sp1 - 2};
+    if (sp2 != q) {
+        http_params = {begin + q,sp2 - q};
+    }
+    http_version = {begin + sp2 + 6,ver.size() - 5};
     //set default connection behavior
-    http_persistent = http_version == "1.1";
-    
-    state = HEADERS;
+    http_persistent = ver.substr(5) == "1.1";
     return true;
 }
 
-void http_request::parse_headers(const std::string& line)
+bool http_request::parse_header(const char *base,size_t begin,size_t end)
 {
-    regex patten("^([^:]*): ?(.*)$");
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {
-        http_headers[subMatch[1]] = subMatch[2];
-        if (subMatch[1] == "Connection") {
-            http_persistent = subMatch[2] != "close";
-        }
+    //name: value
+    auto colon = begin + simd_scan::find_of(base + begin,end - begin,':',':');
+    if (colon == end || colon == begin || n_header == max_headers) {
+        return false;
+    }
+    auto &h = headers[n_header++];
+    h.name = {begin,colon - begin};
+    //trim optional white spaces around value
+    size_t vb = colon + 1;
+    size_t ve = end;
+    while (vb < ve && (base[vb] == ' ' || base[vb] == '\t')) {
+        ++vb;
+    }
+    while (ve > vb && (base[ve - 1] == ' ' || base[ve - 1] == '\t')) {
+        --ve;
+    }
+    h.value = {vb,ve - vb};
+    return true;
+}
+
+bool http_request::end_headers()
+{
+    auto conn = header("Connection");
+    if (!conn.empty()) {
+        http_persistent = !iequals(conn,"close");
     }
-    else {
-        state = BODY;
+    //bodies of unknown length are not supported
+    if (!header("Transfer-Encoding").empty()) {
+        return false;
     }
+    auto len = header("Content-Length");
+    content_len = 0;
+    for (auto c : len) {
+        if (c < '0' || c > '9' || content_len > max_head_size) {
+            return false;
+        }
+        content_len = content_len * 10 + (c - '0');
+    }
+    //a body has to fit in the buffer like the head
+    return content_len <= max_head_size;
 }
 
-void http_request::parse_body(const std::string& line)
+http_request::http_parse_state http_request::fail()
 {
-    http_body = line;
-    state = FINISH;
-}
\ No newline at end of file
+    http_code = 400;
+    //where the next request starts is unknown
+    http_persistent = false;
+    state = SYNTAX_ERROR;
+    return state;
+}
@@ -3,14 +3,22 @@
 
 #include "scalable_buffer/scalable_buffer.hh"
 #include "logger/logger.hh"
+#include "simd_scan/simd_scan.hh"
+
+#include <strings.h>
 
 #include <string>
-#include <unordered_map>
-#include <regex>
+#include <string_view>
 #include <stdexcept>
 
 #include <dbg.h>
 
+//incremental parser working in place over the bytes received
+//token boundaries are found by simd_scan
+//parse results are offsets into the buffer, handed out as string_views; nothing is copied or allocated per request
+//a request may arrive in any number of pieces, split anywhere, even in the middle of a line
+//results are valid until the buffer is cleared or retrieved past them
+
 class http_request
 {
 public:
@@ -21,75 +29,90 @@ public:
         FINISH,
         SYNTAX_ERROR
     };
+    //at most this many header lines
+    static const size_t max_headers = 32;
+    //request line and header lines larger than this in total are refused
+    static const size_t max_head_size = 65536;
+
     http_request();
     ~http_request();
     //clear internal buffers; ready for reuse in another parse
     void reset();
     //set appropriate internal vars and parse state
-    http_parse_state parse(scalable_buffer &buf);
+    //buf must be the same buffer from the first call after reset() on, with the request at its base()
+    http_parse_state parse(const scalable_buffer &buf);
+    http_parse_state parse_state() const {
+        return state;
+    }
+    //bytes of buffer taken by the request parsed; valid when FINISH
+    size_t consumed() const {
+        return pos;
+    }
     //functions to retrieve parse results
-    inline const std::string &method() const;
-    inline const std::string &path() const;
-    inline const std::string &params() const;
-    inline const std::string &version() const;
-    inline const std::unordered_map<std::string,std::string> &headers() const;
-    inline const std::string &body() const;
-    inline bool persistent() const;
-    inline const int code() const;
+    std::string_view method() const {
+        return view(http_method);
+    }
+    //without the leading '/'
+    std::string_view path() const {
+        return view(http_path);
+    }
+    //with the leading '?', if any
+    std::string_view params() const {
+        return view(http_params);
+    }
+    std::string_view version() const {
+        return view(http_version);
+    }
+    //value of header name, case-insensitive; empty if absent
+    std::string_view header(std::string_view name) const;
+    size_t header_count() const {
+        return n_header;
+    }
+    std::string_view body() const {
+        return view(http_body);
+    }
+    bool persistent() const {
+        return http_persistent;
+    }
+    int code() const {
+        return http_code;
+    }
 
 private:
+    //[off,off + len) of buffer
+    struct span {
+        size_t off = 0;
+        size_t len = 0;
+    };
+    struct header_span {
+        span name;
+        span value;
+    };
+
     http_parse_state state;
-    std::string http_method, http_path, http_params, http_version;
-    std::unordered_map<std::string,std::string> http_headers;
-    std::string http_body;
-    bool http_persistent;   //<side effect of http_headers
+    const scalable_buffer *src = nullptr;
+    size_t pos;     //<start of the line being parsed
+    size_t scan;    //<where to go on looking for the end of the line
+    span http_method, http_path, http_params, http_version, http_body;
+    header_span headers[max_headers];
+    size_t n_header;
+    size_t content_len;
+    bool http_persistent;
     int http_code;
 
-    static const char *eol;  //end of line; \r\n
-
-    bool parse_request_line(const std::string& line);
-    void parse_headers(const std::string& line);
-    void parse_body(const std::string& line);
+    std::string_view view(const span &s) const {
+        return src ? std::string_view(src->base() + s.off,s.len) : std::string_view();
+    }
+    static bool iequals(std::string_view a,std::string_view b) {
+        return a.size() == b.size() && strncasecmp(a.data(),b.data(),a.size()) == 0;
+    }
+    //offset of the next CRLF from scan on, or npos if not received yet
+    size_t find_eol(const char *base,size_t len);
+    bool parse_request_line(const char *base,size_t begin,size_t end);
+    bool parse_header(const char *base,size_t begin,size_t end);
+    //take side effects of headers; false if the request can't be served
+    bool end_headers();
+    http_parse_state fail();
 };
 
-const std::string &http_request::method() const
-{
-    return http_method;
-}
-
-const std::string &http_request::path() const
-{
-    return http_path;
-}
-
-const std::string &http_request::params() const
-{
-    return http_params;
-}
-
-const std::string &http_request::version() const
-{
-    return http_version;
-}
-
-const std::unordered_map<std::string,std::string> &http_request::headers() const
-{
-    return http_headers;
-}
-
-const std::string &http_request::body() const
-{
-    return http_body;
-}
-
-bool http_request::persistent() const
-{
-    return http_persistent;
-}
-
-const int http_request::code() const
-{
-    return http_code;
-}
-
-#endif //HTTP_REQUEST_HH
\ No newline at end of file
+#endif //HTTP_REQUEST_HH
@@ -3,6 +3,9 @@
 using namespace std;
 
 const char *http_response::eol = "\r\n";
+bool http_response::use_sendfile = false;
+file_cache *http_response::cache = nullptr;
+string http_response::keep_alive = "keep-alive: timeout=120";
 
 const unordered_map<int, string> http_response::desc = {
     {200, "OK"},
@@ -14,38 +17,64 @@ const unordered_map<int, string> http_response::desc = {
     {503, "Service Unavailable"}
 };
 
+const unordered_map<int,string> http_response::err_pages = [] {
+    unordered_map<int,string> pages;
+    for (auto &d : desc) {
+        if (d.first != 200) {
+            pages.emplace(d.first,err_msg(d.first));
+        }
+    }
+    return pages;
+}();
+
 const std::set<std::string> http_response::default_index_pages = {
     "index.html",
     "index.htm",
     "index.php"
 };
 
-void http_response::init(const http_request &req,scalable_buffer &buf,std::string root,const std::set<std::string> &index_pages)
+void http_response::init(const http_request &req,scalable_buffer &buf,arena &mem,const std::string &root,const std::set<std::string> &index_pages)
 {
-    this->index_pages = index_pages;
     http_code = req.code();
     http_path = req.path();
     http_version = req.version().empty() ? "1.1" : req.version();    //when syntax error, respond with version 1.1
     http_persistent = req.persistent();
 
-    buf.clear();
-    if (root.back() != '/') {   //root folder not ended with '/'
-        root.push_back('/');
-    }
+    release_body();
     //deal with http code
-    if (http_code == 200) {
-        if (http_path != "") {
-            file_path = root + http_path;
-            if (stat(file_path.c_str(),&fstat) < 0 || S_ISDIR(fstat.st_mode)) {
+    if (http_code == 200 && cache) {
+        if (!http_path.empty()) {
+            make_path(mem,root,http_path);
+            cached = cache->get(file_path);
+        }
+        //root; try with every index page
+        else {
+            for (const auto &page : index_pages) {
+                make_path(mem,root,page);
+                cached = cache->get(file_path);
+                if (cached->found) {
+                    break;
+                }
+            }
+        }
+        if (!cached || !cached->found) {
+            http_code = 404;
+            cached.reset();
+        }
+    }
+    else if (http_code == 200) {
+        if (!http_path.empty()) {
+            make_path(mem,root,http_path);
+            if (stat(file_path.data(),&fstat) < 0 || S_ISDIR(fstat.st_mode)) {
                 http_code = 404;
             }
         }
-        //root; try with every default index page
+        //root; try with every index page
         else {
             http_code = 404;
-            for (const auto &page : default_index_pages) {
-                file_path = root + page;
-                if (stat(file_path.c_str(),&fstat) == 0 && !S_ISDIR(fstat.st_mode)) {
+            for (const auto &page : index_pages) {
+                make_path(mem,root,page);
+                if (stat(file_path.data(),&fstat) == 0 && !S_ISDIR(fstat.st_mode)) {
                     http_code = 200;
                     break;
                 }
@@ -58,19 +87,43 @@ void http_response::init(const http_request &req,scalable_buffer &buf,std::strin
     map_body();
     //header lines
     make_header_lines(buf);
-    //blank line separating body and non-body parts
-    buf.append(eol);
+    //blank line separating body and non-body parts, which a response kept in memory comes with
+    if (!prebuilt()) {
+        buf.append(eol);
+    }
+}
+
+bool http_response::cached_only(const http_request &req,arena &mem,const std::string &root,const std::set<std::string> &index_pages)
+{
+    if (req.code() != 200) {
+        return true;
+    }
+    //stat() and opening files on every request
+    if (!cache) {
+        return false;
+    }
+    if (!req.path().empty()) {
+        make_path(mem,root,req.path());
+        return cache->peek(file_path) != nullptr;
+    }
+    for (const auto &page : index_pages) {
+        make_path(mem,root,page);
+        auto e = cache->peek(file_path);
+        if (!e) {
+            return false;
+        }
+        if (e->found) {
+            return true;
+        }
+    }
+    return true;
 }
 
 void http_response::init(int code,scalable_buffer &buf)
 {
     http_code = code;
 
-    if (file && munmap(file,content_len) != 0) {
-        log_err("unmap failed!");
-    }
-    file = nullptr;
-    buf.clear();
+    release_body();
     //init
     http_version = "1.1";
     http_persistent = false;
@@ -81,17 +134,46 @@ void http_response::init(int code,scalable_buffer &buf)
     buf.append(eol);
 }
 
+string http_response::canned(int code)
+{
+    auto &body = err_pages.at(code);
+    return "HTTP/1.1 " + to_string(code) + " " + desc.at(code) + eol +
+        "Connection: close" + eol +
+        "Content-type: text/html" + eol +
+        "Content-Length: " + to_string(body.size()) + eol +
+        eol +
+        body;
+}
+
 http_response::~http_response()
+{
+    release_body();
+}
+
+void http_response::release_body()
 {
     if (file && munmap(file,content_len) != 0) {
         log_err("unmap failed!");
     }
+    file = nullptr;
+    err_page = nullptr;
+    cached.reset();
+    if (file_fd >= 0) {
+        close(file_fd);
+        file_fd = -1;
+    }
+}
+
+void http_response::make_path(arena &mem,const string &root,string_view name)
+{
+    //root folder not ended with '/'
+    file_path = mem.concat({root,root.empty() || root.back() != '/' ? "/" : "",name});
 }
 
 void http_response::make_status_line(scalable_buffer &buf)
 {
     buf.append("HTTP/");
-    buf.append(http_version);
+    buf.append(http_version.data(),http_version.size());
     buf.append(" ");
     buf.append(to_string(http_code));
     buf.append(" ");
@@ -110,12 +192,21 @@ void http_response::make_header_lines(scalable_buffer &buf)
     if (http_persistent) {
         buf.append("keep-alive");
         buf.append(eol);
-        buf.append("keep-alive: max=6, timeout=120");
+        buf.append(keep_alive);
     }
     else {
         buf.append("close");
     }
     buf.append(eol);
+    //the rest comes with the body of a response kept in memory
+    if (prebuilt()) {
+        return;
+    }
+    //Content-type and Content-Length of cached file are ready-made
+    if (cached) {
+        buf.append(cached->header);
+        return;
+    }
     //Content-type
     buf.append("Content-type: ");
     buf.append(file_type());
@@ -128,9 +219,15 @@ void http_response::make_header_lines(scalable_buffer &buf)
 
 void http_response::map_body()
 {
-    if (http_code == 200) {
+    if (prebuilt()) {
+        content_len = cached->response.size();
+    }
+    else if (cached) {
+        content_len = cached->st.st_size;
+    }
+    else if (http_code == 200) {
         content_len = fstat.st_size;
-        int fd = open(file_path.c_str(),O_RDONLY);
+        int fd = open(file_path.data(),O_RDONLY);
         if (fd < 0) {
             log_err("response file open error");
             file = nullptr;
@@ -138,6 +235,11 @@ void http_response::map_body()
             return;
             // throw runtime_error("response file open error");
         }
+        //sent from the file by the connection, without mapping it
+        if (use_sendfile) {
+            file_fd = fd;
+            return;
+        }
         if ((file = static_cast<char *>(mmap(0,content_len,PROT_READ,MAP_PRIVATE,fd,0))) == MAP_FAILED) {
             file = nullptr;
             content_len = 0;
@@ -146,21 +248,14 @@ void http_response::map_body()
         close(fd);
     }
     else {
-        auto body = err_msg();
-        content_len = body.size();
-        if ((file = static_cast<char *>(mmap(0,content_len,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0))) == MAP_FAILED) {
-            file = nullptr;
-            content_len = 0;
-            log_err("response mapping for error message failed");
-            return;
-        }
-        memcpy(file,body.c_str(),content_len);
+        err_page = &err_pages.at(http_code);
+        content_len = err_page->size();
     }
 }
 
-string http_response::err_msg()
+string http_response::err_msg(int code)
 {
-    auto mess = to_string(http_code) + " " + desc.at(http_code);
+    auto mess = to_string(code) + " " + desc.at(code);
     return "<html><head><title>" +
         mess +
         "</title></head><body><center><h1>" +
@@ -170,16 +265,28 @@ string http_response::err_msg()
 
 std::pair<char *,size_t> http_response::body() const
 {
-    return {file,content_len};
+    if (prebuilt()) {
+        return {const_cast<char *>(cached->response.data()),content_len};
+    }
+    if (err_page) {
+        return {const_cast<char *>(err_page->data()),content_len};
+    }
+    return {cached ? cached->map : file,content_len};
 }
 
-std::string http_response::gmt_time()
+const char *http_response::gmt_time()
 {
+    //formatted once a second by every thread
+    thread_local time_t last = 0;
+    thread_local char buf[64];
     auto now = time(nullptr);
-    auto tm = gmtime(&now);
-    char buf[64];
-    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S %Z", tm);
-    return string(buf);
+    if (now != last) {
+        struct tm tm;
+        gmtime_r(&now,&tm);
+        strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S %Z", &tm);
+        last = now;
+    }
+    return buf;
 }
 
 const unordered_map<string, string> http_response::suffix_type = {
@@ -205,18 +312,25 @@ const unordered_map<string, string> http_response::suffix_type = {
     {".js", "text/javascript"},
 };
 
-std::string http_response::file_type()
+const std::string &http_response::file_type()
 {
     if (http_code != 200) {
         return suffix_type.at(".html");
     }
-    auto pos = file_path.find_last_of('.');
-    if(pos == string::npos) {
-        return "text/plain";
+    return file_type(file_path);
+}
+
+const std::string &http_response::file_type(string_view path)
+{
+    static const string plain = "text/plain";
+    auto pos = path.find_last_of('.');
+    //suffixes known are short enough for the key not to allocate
+    if(pos == string::npos || path.size() - pos > max_suffix) {
+        return plain;
     }
-    auto suffix = file_path.substr(pos);
-    if(suffix_type.count(suffix) == 1) {
-        return suffix_type.at(suffix);
+    auto it = suffix_type.find(string(path.substr(pos)));
+    if(it != suffix_type.end()) {
+        return it->second;
     }
-    return "text/plain";
+    return plain;
 }
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include "scalable_buffer/scalable_buffer.hh"
 #include "logger/logger.hh"
 #include "http_request/http_request.hh"
+#include "file_cache/file_cache.hh"
+#include "arena/arena.hh"
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -11,51 +13,95 @@
 #include <sys/mman.h>
 
 #include <string>
+#include <string_view>
 #include <ctime>
 #include <set>  //ordered set to get the first matched default index page
 #include <unordered_map>
 #include <utility>
+#include <memory>
 
 class http_response
 {
 public:
     http_response() = default;
-    void init(const http_request &req,scalable_buffer &buf,std::string root,const std::set<std::string> &index_pages = default_index_pages);
-    void init(const http_request &req,scalable_buffer &buf,std::string root,std::set<std::string> &&index_pages) {
-        init(req,buf,root,index_pages);
-    }
+    //root and index_pages are the server's, only looked at here; index pages are tried in order for the path of root
+    //paths of files are built in mem, so that answering a request allocates nothing
+    void init(const http_request &req,scalable_buffer &buf,arena &mem,const std::string &root,const std::set<std::string> &index_pages = default_index_pages);
+    //whether init() with the same arguments would make the response without touching the file system
+    //true if the file, or every index page tried before one found, is in the file cache, or no file is looked for
+    bool cached_only(const http_request &req,arena &mem,const std::string &root,const std::set<std::string> &index_pages = default_index_pages);
     //generate error http response by http code
     void init(int code,scalable_buffer &buf);
+    //a whole error response by http code, closing the connection, to be made once and sent as is
+    //without Date, which only a 5xx response may go without
+    static std::string canned(int code);
     ~http_response();
-    //address and length of body content
+    //address and length of body content; address is null if the body is to be sent from body_fd()
+    //for a small file kept in memory, it's the entity header lines and blank line followed by the content
     std::pair<char *,size_t> body() const;
+    //descriptor of the file to send as body with sendfile(), otherwise -1
+    int body_fd() const {
+        return cached ? cached->fd : file_fd;
+    }
+    //send files with sendfile() instead of mapping them; mapping by default
+    static void set_sendfile(bool on) {
+        use_sendfile = on;
+    }
+    static bool get_sendfile() {
+        return use_sendfile;
+    }
+    //look files up in cache instead of the file system; none by default
+    static void set_file_cache(file_cache *cache) {
+        http_response::cache = cache;
+    }
+    //how long an idle persistent connection is kept, as told to clients in the keep-alive header
+    static void set_keep_alive(size_t timeout_s) {
+        keep_alive = "keep-alive: timeout=" + std::to_string(timeout_s);
+    }
+    //MIME type by suffix of path
+    static const std::string &file_type(std::string_view path);
+    static const std::set<std::string> default_index_pages; //<default index pages; will be looked up in order
 
 private:
     static const std::unordered_map<int,std::string> desc;
+    static const std::unordered_map<int,std::string> err_pages; //<bodies of error responses by http code, made once
     static const std::unordered_map<std::string,std::string> suffix_type;
-    static const std::set<std::string> default_index_pages; //<default index pages; will be looked up in order
+    static const size_t max_suffix = 8; //<longer than any suffix known, dot included
     static const char *eol;  //end of line; \r\n
+    static bool use_sendfile;
+    static file_cache *cache;
+    static std::string keep_alive;  //<keep-alive header line, without eol
 
-    std::set<std::string> index_pages;  //<index pages
-
-    //from request
+    //from request; views into it and the arena, valid within init() only
     int http_code;
-    std::string http_path;
-    std::string http_version;
+    std::string_view http_path;
+    std::string_view http_version;
     bool http_persistent;
     //generate for response
-    std::string file_path;
+    std::string_view file_path; //<NUL-terminated
     char *file = nullptr;
+    const std::string *err_page = nullptr;  //<body if an error response
+    int file_fd = -1;
+    std::shared_ptr<const file_cache::entry> cached;    //<body from cache if not null
     struct stat fstat;
     size_t content_len;
 
+    //root and name joined into file_path
+    void make_path(arena &mem,const std::string &root,std::string_view name);
     void make_status_line(scalable_buffer &buf);
     void make_header_lines(scalable_buffer &buf);
+    //true if the body is a response kept in memory by cache
+    bool prebuilt() const {
+        return cached && !cached->response.empty();
+    }
+    //map body, or open it for sendfile()
     void map_body();
-    std::string err_msg();
+    //unmap or close body of last response
+    void release_body();
+    static std::string err_msg(int code);
 
-    std::string gmt_time();
-    std::string file_type();
+    const char *gmt_time();
+    const std::string &file_type();
 };
 
 #endif //HTTP_RESONSE_HH
\ No newline at end of file
@@ -8,7 +8,7 @@ logger *logger::instance()
     return &ins;
 }
 
-void logger::init(const string log_path,log_level target_level, bool async, size_t max_queue_capacity)
+void logger::init(const string log_path,log_level target_level, bool async, size_t ring_size)
 {
     enabled = true;
     //create at O_APPEND mode, writes are atomic, no lock needed
@@ -16,17 +16,34 @@ void logger::init(const string log_path,log_level target_level, bool async, size
         throw runtime_error("open error");
     }
     this->async = async;
-    //only one worker thread for log writing
+    this->target_level = target_level;
+    //only one flusher thread for log writing
     if (async) {
-        pool = new thread_pool(1,max_queue_capacity);
+        this->ring_size = 1;
+        while (this->ring_size < ring_size) {
+            this->ring_size <<= 1;
+        }
+        if (pthread_mutex_init(&rings_mutex,nullptr) < 0) {
+            throw runtime_error("pthread_mutex_init error");
+        }
+        //joined when destroyed
+        if (pthread_create(&flusher,nullptr,flusher_thrd_fn,this) != 0) {
+            throw runtime_error("pthread_create error");
+        }
     }
-    this->target_level = target_level;
 }
 
 logger::~logger()
 {
-    close(fd);
-    delete pool;
+    if (enabled && async) {
+        stopping.store(true,memory_order_relaxed);
+        wake_flusher();
+        pthread_join(flusher,nullptr);
+        pthread_mutex_destroy(&rings_mutex);
+    }
+    if (enabled) {
+        close(fd);
+    }
 }
 
 void logger::log(logger::log_level level,const string &msg)
@@ -36,59 +53,214 @@ void logger::log(logger::log_level level,const string &msg)
     }
     if (!async) {
         log_write(level,msg);   //write right now
+        return;
+    }
+    auto &r = local_ring();
+    size_t stamp_len;
+    auto stamp = datetime(stamp_len);
+    size_t len = level_len + stamp_len + msg.size() + 1;
+    auto head = r.head.load(memory_order_relaxed);
+    auto used = head - r.tail.load(memory_order_acquire);
+    if (used + len > r.mask + 1) {
+        r.dropped.fetch_add(1,memory_order_relaxed);
+        return;
     }
-    else {
-        pool->push(std::bind(&logger::log_write,this,level,msg));    //add to task queue
+    put(r,head,level_tag(level),level_len);
+    put(r,head + level_len,stamp,stamp_len);
+    put(r,head + level_len + stamp_len,msg.data(),msg.size());
+    put(r,head + len - 1,"\n",1);
+    r.head.store(head + len,memory_order_release);
+    //wake the flusher once as the ring gets half full, and leave it to the interval otherwise
+    auto half = (r.mask + 1) / 2;
+    if (used < half && used + len >= half) {
+        wake_flusher();
     }
 }
 
-//do the real thing
-void logger::log_write(logger::log_level level,const string &msg)
+void logger::flush()
 {
-    //only one worker thread doing logging, so buffer can be reused by all logging tasks
-    buffer.clear();
-    //level
-    append_level(level);
-    //datetime
-    append_datetime();
-    //msg
-    buffer.append(msg.c_str());
-    buffer.append("\n");
-    
-    ssize_t len = buffer.len();
-    ssize_t tem;
-    // fprintf(stdout,"before write buffer.len() = %ld\n",buffer.len());
-    for (size_t i(0); (tem = write(fd,buffer.base(),len)) != len && i < max_retry; ++i) {
-        fprintf(stdout,"after write (error) buffer.len() = %ld\n",buffer.len());
-        fprintf(stderr,"log write error! wrote %ld while %ld expected! retrying\n",tem,len);
-        buffer.retrieved(tem);
+    if (!enabled || !async) {
+        return;
+    }
+    //wait until the flusher has gone past what's there now
+    vector<pair<ring *,size_t>> heads;
+    pthread_mutex_lock(&rings_mutex);
+    for (auto &r : rings) {
+        heads.emplace_back(r.get(),r->head.load(memory_order_acquire));
+    }
+    pthread_mutex_unlock(&rings_mutex);
+    wake_flusher();
+    for (auto &h : heads) {
+        while (h.first->tail.load(memory_order_acquire) < h.second) {
+            usleep(1000);
+        }
     }
-    // fprintf(stdout," after write buffer.len() = %ld\n",buffer.len());
 }
 
-void logger::append_level(log_level level)
+const char *logger::level_tag(log_level level)
 {
     switch(level) {
         case INFO:
-            buffer.append("[info]  ");
-            break;
+            return "[info]  ";
         case WARN:
-            buffer.append("[warn]  ");
-            break;
+            return "[warn]  ";
         case ERR:
-            buffer.append("[error] ");
-            break;
-        case DEBUG:
-            buffer.append("[debug] ");
-            break;
+            return "[error] ";
+        default:
+            return "[debug] ";
     }
 }
 
-void logger::append_datetime()
+const char *logger::datetime(size_t &len)
 {
+    thread_local time_t last = 0;
+    thread_local char buf[64];
+    thread_local size_t buf_len = 0;
     auto now = time(nullptr);
-    auto tm = gmtime(&now);
-    char buf[64];
-    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S %Z: ", tm);
-    buffer.append(buf);
-}
\ No newline at end of file
+    if (now != last) {
+        struct tm tm;
+        gmtime_r(&now,&tm);
+        buf_len = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S %Z: ", &tm);
+        last = now;
+    }
+    len = buf_len;
+    return buf;
+}
+
+logger::ring &logger::local_ring()
+{
+    //one logger per process, so one ring per thread
+    thread_local ring *mine = nullptr;
+    if (!mine) {
+        pthread_mutex_lock(&rings_mutex);
+        rings.emplace_back(new ring(ring_size));
+        mine = rings.back().get();
+        pthread_mutex_unlock(&rings_mutex);
+    }
+    return *mine;
+}
+
+void logger::put(ring &r,size_t pos,const char *s,size_t len)
+{
+    auto off = pos & r.mask;
+    auto first = min(len,r.mask + 1 - off);
+    memcpy(r.data.get() + off,s,first);
+    memcpy(r.data.get(),s + first,len - first);
+}
+
+//do the real thing
+void logger::log_write(logger::log_level level,const string &msg)
+{
+    //every thread formats into a buffer of its own, reused by its records
+    thread_local string line;
+    size_t stamp_len;
+    auto stamp = datetime(stamp_len);
+    line.assign(level_tag(level),level_len);
+    line.append(stamp,stamp_len);
+    line.append(msg);
+    line.push_back('\n');
+
+    const char *p = line.data();
+    ssize_t len = line.size();
+    ssize_t tem;
+    for (size_t i(0); (tem = write(fd,p,len)) != len && i < max_retry; ++i) {
+        fprintf(stderr,"log write error! wrote %ld while %ld expected! retrying\n",tem,len);
+        if (tem > 0) {
+            p += tem;
+            len -= tem;
+        }
+    }
+}
+
+void logger::drain()
+{
+    //rings made meanwhile are taken next time
+    pthread_mutex_lock(&rings_mutex);
+    draining.clear();
+    for (auto &r : rings) {
+        draining.push_back(r.get());
+    }
+    pthread_mutex_unlock(&rings_mutex);
+
+    iovec iov[IOV_MAX];
+    int n = 0;
+    size_t dropped = 0;
+    committing.clear();
+    for (auto r : draining) {
+        dropped += r->dropped.exchange(0,memory_order_relaxed);
+        auto tail = r->tail.load(memory_order_relaxed);
+        auto head = r->head.load(memory_order_acquire);
+        if (head == tail) {
+            continue;
+        }
+        //batch full; the notice below needs one more
+        if (n + 3 > IOV_MAX) {
+            writev_all(iov,n);
+            n = 0;
+        }
+        auto off = tail & r->mask;
+        auto len = head - tail;
+        auto first = min(len,r->mask + 1 - off);
+        iov[n++] = {r->data.get() + off,first};
+        if (len > first) {
+            iov[n++] = {r->data.get(),len - first};
+        }
+        committing.emplace_back(r,head);
+    }
+    if (dropped) {
+        n_dropped.fetch_add(dropped,memory_order_relaxed);
+        size_t stamp_len;
+        auto stamp = datetime(stamp_len);
+        notice.assign(level_tag(WARN),level_len);
+        notice.append(stamp,stamp_len);
+        notice.append(to_string(dropped) + " log records dropped for full buffers\n");
+        iov[n++] = {&notice[0],notice.size()};
+    }
+    writev_all(iov,n);
+}
+
+void logger::writev_all(iovec *iov,int n)
+{
+    for (size_t i(0); n > 0 && i < max_retry; ++i) {
+        auto tem = writev(fd,iov,n);
+        if (tem < 0) {
+            fprintf(stderr,"log writev error! retrying\n");
+            continue;
+        }
+        //skip what's written
+        while (n > 0 && static_cast<size_t>(tem) >= iov->iov_len) {
+            tem -= iov->iov_len;
+            ++iov;
+            --n;
+        }
+        if (n > 0) {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + tem;
+            iov->iov_len -= tem;
+        }
+    }
+    //the room is given back even if the write failed, so that logging goes on
+    for (auto &c : committing) {
+        c.first->tail.store(c.second,memory_order_release);
+    }
+    committing.clear();
+}
+
+void logger::wake_flusher()
+{
+    epoch.fetch_add(1,memory_order_release);
+    syscall(SYS_futex,&epoch,FUTEX_WAKE_PRIVATE,1,nullptr,nullptr,0);
+}
+
+void *logger::flusher_thrd_fn(void *arg)
+{
+    auto l = static_cast<logger *>(arg);
+    timespec interval{0,flush_interval_ms * 1000000L};
+    while (!l->stopping.load(memory_order_relaxed)) {
+        auto e = l->epoch.load(memory_order_acquire);
+        l->drain();
+        //a wake-up after the drain returns this at once, and one missed costs an interval at most
+        syscall(SYS_futex,&l->epoch,FUTEX_WAIT_PRIVATE,e,&interval,nullptr,0);
+    }
+    l->drain();
+    return nullptr;
+}
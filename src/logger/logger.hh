@@ -1,18 +1,28 @@
 #ifndef LOGGER_HH
 #define LOGGER_HH
 
-#include "scalable_buffer/scalable_buffer.hh"
-#include "thread_pool/thread_pool.hh"
+#include "cpu_topology/cpu_topology.hh"
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 #include <string>
-#include <queue>
+#include <vector>
+#include <memory>
+#include <atomic>
 #include <stdexcept>
 
+//in async mode, every thread logging formats its records into a byte ring of its own, without any lock or allocation
+//a flusher thread drains all rings together by writev(), every flush_interval_ms or as soon as a ring gets half full
+//a record that doesn't fit into its ring is dropped and counted, instead of blocking the thread logging it
+
 class logger
 {
 public:
@@ -22,39 +32,94 @@ public:
         WARN,
         ERR
     };
-    
+
     static logger *instance();
-    void init(const std::string log_path = "/var/log/webserver.log",log_level target_level = INFO, bool async = false, size_t max_queue_capacity = 512);
+    //ring_size is in bytes, rounded up to a power of 2
+    void init(const std::string log_path = "/var/log/webserver.log",log_level target_level = INFO, bool async = false, size_t ring_size = 65536);
     ~logger();
+    //whether records of level are written; the log_*() macros below check it before making the message
+    bool enabled_for(log_level level) const {
+        return enabled && level >= target_level;
+    }
     void log(log_level level,const std::string &msg);
     void log(log_level level,std::string &&msg) {
         log(level,msg);
     }
-    void flush() {
+    //block until records logged so far are written
+    void flush();
+    //pin the flusher thread, if any
+    void pin(const cpu_set_t &mask) {
         if (enabled && async) {
-            pool->block();
+            cpu_topology::pin(flusher,mask);
         }
     }
-    
+    //records dropped for full rings so far
+    size_t dropped() const {
+        return n_dropped.load(std::memory_order_relaxed);
+    }
+
 private:
+    static const int flush_interval_ms = 10;
+    static const size_t level_len = 8;  //<"[level] " padded
+
+    //single producer, the thread owning it, and single consumer, the flusher
+    struct ring {
+        explicit ring(size_t size) : mask(size - 1),data(new char[size]) {}
+        size_t mask;
+        std::unique_ptr<char[]> data;
+        //whole records only are published by head
+        alignas(64) std::atomic<size_t> head{0};
+        alignas(64) std::atomic<size_t> tail{0};
+        std::atomic<size_t> dropped{0};
+    };
+
     logger() {}
-    void append_level(log_level level);
-    void append_datetime();
+    static const char *level_tag(log_level level);
+    //"date time: " of now, formatted once a second by every thread
+    static const char *datetime(size_t &len);
+    //the calling thread's ring, made at its first record
+    ring &local_ring();
+    //copy into the ring at pos, wrapping around
+    static void put(ring &r,size_t pos,const char *s,size_t len);
+    //write a record right now, for sync mode
     void log_write(log_level level,const std::string &msg);
+    //write out what all rings have by batches of writev()
+    void drain();
+    void writev_all(iovec *iov,int n);
+    void wake_flusher();
+    static void *flusher_thrd_fn(void *arg);
 
     bool enabled = false;
     int fd; //<for log file
     bool async;
-    scalable_buffer buffer{4096};   //the size of one page on most machines
-    thread_pool *pool;   //<for asynchronous logging;
     log_level target_level;
     const size_t max_retry = 5;
+    //async mode
+    size_t ring_size;
+    pthread_t flusher;
+    std::atomic<bool> stopping{false};
+    std::atomic<int> epoch{0};  //<futex the flusher sleeps on
+    pthread_mutex_t rings_mutex;
+    std::vector<std::unique_ptr<ring>> rings;
+    std::atomic<size_t> n_dropped{0};
+    //used by the flusher only
+    std::vector<ring *> draining;
+    std::vector<std::pair<ring *,size_t>> committing;
+    std::string notice;
 };
 
+//levels below LOG_MIN_LEVEL are compiled out, e.g. -DLOG_MIN_LEVEL=1 for no debug logging at all
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+//constant false for a level compiled out, which drops the code it guards
+#define log_enabled(L) (logger::L >= LOG_MIN_LEVEL && logger::instance()->enabled_for(logger::L))
+
 //useful
-#define log_debug(X) logger::instance()->log(logger::DEBUG,(X))
-#define log_info(X) logger::instance()->log(logger::INFO,(X))
-#define log_warn(X) logger::instance()->log(logger::WARN,(X))
-#define log_err(X) logger::instance()->log(logger::ERR,(X))
+//X, the message, is evaluated only if the level is written, so a level off costs a branch and nothing else
+#define log_debug(X) do { if (log_enabled(DEBUG)) logger::instance()->log(logger::DEBUG,(X)); } while (0)
+#define log_info(X) do { if (log_enabled(INFO)) logger::instance()->log(logger::INFO,(X)); } while (0)
+#define log_warn(X) do { if (log_enabled(WARN)) logger::instance()->log(logger::WARN,(X)); } while (0)
+#define log_err(X) do { if (log_enabled(ERR)) logger::instance()->log(logger::ERR,(X)); } while (0)
 
-#endif //LOGGER_HH
\ No newline at end of file
+#endif //LOGGER_HH
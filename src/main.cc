@@ -1,25 +1,42 @@
 #include "webserver/webserver.hh"
 int main()
 {
+    webserver::fork_workers(1); //number of processes sharing the port
     webserver w(
         65530,  //port
         true,   //listen
         true,   //client
         1024,   //max event
+        event_backend::EPOLL,   //IO multiplexing
         128,    //backlog
         "/srv/www/html",
         {"index.html","index.htm","index.php"},
+        true,   //send files by sendfile() instead of mmap()
+        256,    //entries of open file cache; 0 to disable
+        32768,  //files no larger than this are kept in memory as ready-made responses
+        64 << 20,   //memory for files kept
         1024,   //max connection
         1,  //accept thread
-        120, //live time
-        5,  //check interval
+        0,  //sub reactor; 0 for single reactor
+        webserver::ROUND_ROBIN, //how to hand connections to sub reactors: ROUND_ROBIN, LEAST_LOAD, or INCOMING_CPU
+        false,  //SO_REUSEPORT listen socket per accept thread or sub reactor
+        webserver::HYBRID,  //socket IO by working threads(POOL), by reactors(INLINE), or by reactors except large responses(HYBRID)
+        16384,  //largest response written by reactors in HYBRID
+        120000, //keep-alive live time in ms
+        10000,  //header read timeout in ms, counted from the first byte of a request
+        30000,  //body read timeout in ms, since last progress
+        30000,  //write timeout in ms, since last progress
+        100,    //timer tick in ms
         true,   //enable logger
         logger::DEBUG,
         "/var/log/webserver.log",
         true,  //async
-        1024,   //log queue cap
+        1 << 16,    //log buffer of every thread logging, in bytes
         12,  //nthread
-        1024    //task queue cap
+        1024,   //task queue cap
+        false,  //work-stealing scheduling, with tasks of a connection kept on one worker
+        webserver::FLOATING,    //pin reactors and working threads to cores(PIN_CORE) or NUMA nodes(PIN_NODE)
+        50  //turn new connections away with 503 while tasks wait in the queue, or events wait behind a reactor's batch, longer than this in ms; 0 to disable
     );
     w.start();
 }
\ No newline at end of file
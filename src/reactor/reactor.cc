@@ -0,0 +1,151 @@
+#include "reactor.hh"
+
+using namespace std;
+
+reactor::reactor(size_t id,size_t max_event,event_backend::type backend,uint64_t tick_ms,event_handler handler,expire_handler on_expire)
+    : _id(id),
+    ep(event_backend::create(backend,max_event)),
+    handler(handler),
+    on_expire(on_expire),
+    wheel(tick_ms)
+{
+    if (pthread_mutex_init(&mutex,nullptr) < 0) {
+        throw runtime_error("pthread_mutex_init error");
+    }
+    if ((wakeup_fd = eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        log_err("eventfd failed");
+        throw runtime_error("eventfd error");
+    }
+    wakeup_tag = conn_registry::make_tag(wakeup_fd,0);
+    ep->add(wakeup_fd,EPOLLIN,wakeup_tag);
+    //tick periodically
+    if ((timer_fd = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+        log_err("timerfd_create failed");
+        throw runtime_error("timerfd_create error");
+    }
+    itimerspec its;
+    its.it_interval.tv_sec = its.it_value.tv_sec = wheel.tick() / 1000;
+    its.it_interval.tv_nsec = its.it_value.tv_nsec = (wheel.tick() % 1000) * 1000000L;
+    if (timerfd_settime(timer_fd,0,&its,nullptr) < 0) {
+        log_err("timerfd_settime failed");
+        throw runtime_error("timerfd_settime error");
+    }
+    timer_tag = conn_registry::make_tag(timer_fd,0);
+    ep->add(timer_fd,EPOLLIN,timer_tag);
+}
+
+reactor::~reactor()
+{
+    ep->del(timer_fd);
+    close(timer_fd);
+    ep->del(wakeup_fd);
+    close(wakeup_fd);
+    pthread_mutex_destroy(&mutex);
+}
+
+void reactor::set_affinity(const cpu_set_t &mask,int node)
+{
+    this->mask = mask;
+    _node = node;
+    _cpu = -1;
+    if (CPU_COUNT(&mask) == 1) {
+        for (int cpu(0); cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu,&mask)) {
+                _cpu = cpu;
+            }
+        }
+    }
+}
+
+void reactor::loop()
+{
+    if (_node >= 0 && !cpu_topology::pin_self(mask)) {
+        log_err("failed to pin reactor " + to_string(_id));
+    }
+    loop_thread.store(pthread_self(),memory_order_relaxed);
+    auto events = ep->events();
+    while (true) {
+        size_t n = ep->wait(-1);
+        log_debug("reactor " + to_string(_id) + " returned from epoll wait. n = " + to_string(n));
+        auto start = now_us();
+        for (size_t i(0); i < n; ++i) {
+            if (events[i].data.u64 == wakeup_tag) {
+                run_pending();
+                continue;
+            }
+            if (events[i].data.u64 == timer_tag) {
+                run_timers();
+                continue;
+            }
+            handler(*this,events[i]);
+        }
+        max_batch_us = max(max_batch_us,now_us() - start);
+    }
+}
+
+void reactor::start()
+{
+    //run in detach state
+    pthread_attr_t attr;
+    if (pthread_attr_init(&attr) < 0) {
+        throw std::runtime_error("pthread_attr_init error");
+    }
+    if (pthread_attr_setdetachstate(&attr,PTHREAD_CREATE_DETACHED) < 0) {
+        throw std::runtime_error("pthread_attr_setdetachstate error");
+    }
+    pthread_t tid;
+    if (pthread_create(&tid,&attr,thrd_fn,this) < 0) {
+        throw std::runtime_error("pthread_create error");
+    }
+}
+
+void reactor::run_in_loop(small_task task)
+{
+    if (in_loop_thread()) {
+        task();
+        return;
+    }
+    pthread_mutex_lock(&mutex);
+    bool wake = pending.empty();
+    pending.push_back(move(task));
+    pthread_mutex_unlock(&mutex);
+    //otherwise the loop has been woken up and not yet taken the queue
+    if (wake) {
+        uint64_t one = 1;
+        if (write(wakeup_fd,&one,sizeof(one)) < 0 && errno != EAGAIN) {
+            log_err("reactor " + to_string(_id) + " wakeup failed");
+        }
+    }
+}
+
+void reactor::run_pending()
+{
+    //drain before taking the queue, so that no wakeup is lost
+    uint64_t cnt;
+    while (read(wakeup_fd,&cnt,sizeof(cnt)) > 0);
+    pthread_mutex_lock(&mutex);
+    running.swap(pending);
+    pthread_mutex_unlock(&mutex);
+    for (auto &task : running) {
+        task();
+    }
+    running.clear();
+}
+
+void reactor::run_timers()
+{
+    uint64_t cnt;
+    while (read(timer_fd,&cnt,sizeof(cnt)) > 0);
+    wheel.advance([this](uint64_t key) {
+        on_expire(*this,key);
+    });
+    if (on_tick) {
+        on_tick(*this);
+    }
+}
+
+void *reactor::thrd_fn(void *arg)
+{
+    static_cast<reactor *>(arg)->loop();
+    return nullptr;  //dummy return
+}
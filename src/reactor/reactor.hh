@@ -0,0 +1,128 @@
+#ifndef REACTOR_HH
+#define REACTOR_HH
+
+#include "event_backend/event_backend.hh"
+#include "conn_registry/conn_registry.hh"
+#include "timer_wheel/timer_wheel.hh"
+#include "logger/logger.hh"
+#include "cpu_topology/cpu_topology.hh"
+#include "task_queue/task_queue.hh"
+
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+
+//an event loop owning one event backend, the connections registered in it and their timers
+//a connection registered in a reactor stays in it from accept to close
+
+class reactor
+{
+public:
+    //called in loop thread for every ready event
+    using event_handler = std::function<void (reactor &,epoll_event &)>;
+    //called in loop thread with key of every timer due
+    using expire_handler = std::function<void (reactor &,uint64_t)>;
+    //called in loop thread once a tick, after timers due
+    using tick_handler = std::function<void (reactor &)>;
+
+    reactor(size_t id,size_t max_event,event_backend::type backend,uint64_t tick_ms,event_handler handler,expire_handler on_expire);
+    ~reactor();
+    //pin the loop thread to mask, on NUMA node node, as soon as it starts looping
+    //connections are constructed in the loop thread, so their memory comes from the local node
+    void set_affinity(const cpu_set_t &mask,int node);
+    //NUMA node pinned to, or -1 if floating
+    int node() const {
+        return _node;
+    }
+    //the CPU pinned to, or -1 if pinned to more than one or floating
+    int cpu() const {
+        return _cpu;
+    }
+    //must be set before the loop starts; none by default
+    void set_tick_handler(tick_handler on_tick) {
+        this->on_tick = on_tick;
+    }
+    //run the loop in calling thread; never returns
+    void loop();
+    //run the loop in a new detached thread
+    void start();
+    //run task in loop thread; right now if called in loop thread, otherwise queued and the loop is woken up
+    //a task small enough for small_task is queued without allocation
+    void run_in_loop(small_task task);
+    bool in_loop_thread() const {
+        return pthread_equal(loop_thread.load(std::memory_order_relaxed),pthread_self());
+    }
+    event_backend &poller() {
+        return *ep;
+    }
+    //must be used in loop thread only
+    conn_registry &conns() {
+        return registry;
+    }
+    //must be used in loop thread only; driven by a timerfd ticking at the wheel's resolution
+    timer_wheel &timers() {
+        return wheel;
+    }
+    size_t id() const {
+        return _id;
+    }
+    //number of connections owned; just a hint
+    size_t load() const {
+        return n_conn.load(std::memory_order_relaxed);
+    }
+    void incr_load() {
+        n_conn.fetch_add(1,std::memory_order_relaxed);
+    }
+    void decr_load() {
+        n_conn.fetch_sub(1,std::memory_order_relaxed);
+    }
+    //the longest a batch of ready events took to handle since last called, in us, which is how long an event may wait behind the others
+    //must be called in loop thread, e.g. by the tick handler
+    uint32_t take_batch_us() {
+        auto t = max_batch_us;
+        max_batch_us = 0;
+        return t;
+    }
+
+private:
+    size_t _id;
+    std::unique_ptr<event_backend> ep;
+    event_handler handler;
+    expire_handler on_expire;
+    tick_handler on_tick;
+    conn_registry registry;
+    timer_wheel wheel;
+    int timer_fd;
+    uint64_t timer_tag;
+    std::atomic<size_t> n_conn{0};
+    cpu_set_t mask;
+    int _node = -1;
+    int _cpu = -1;
+    std::atomic<pthread_t> loop_thread{0};
+    uint32_t max_batch_us = 0;
+    //for run_in_loop()
+    int wakeup_fd;
+    uint64_t wakeup_tag;
+    pthread_mutex_t mutex;
+    std::vector<small_task> pending;
+    std::vector<small_task> running;    //<pending taken by the loop; both keep their room
+
+    void run_pending();
+    void run_timers();
+    //microseconds of monotonic clock, wrapping around
+    static uint32_t now_us() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC,&ts);
+        return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+    static void *thrd_fn(void *arg);
+};
+
+#endif //REACTOR_HH
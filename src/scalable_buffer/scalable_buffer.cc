@@ -2,8 +2,6 @@
 
 using namespace std;
 
-const size_t scalable_buffer::aux_buffer_sz = 65536;
-
 void scalable_buffer::append(const char *buf,size_t len)
 {
     while (avail() < len) {
@@ -49,9 +47,10 @@ ssize_t scalable_buffer::read_fd(int fd)
     struct iovec iov[2];
     iov[0].iov_base = static_cast<char *>(ptr) + head;
     iov[0].iov_len = avail();
-    char aux[aux_buffer_sz];
+    //shared by all buffers of the thread, rather than fresh stack pages on every call
+    char *aux = buffer_pool::scratch();
     iov[1].iov_base = aux;
-    iov[1].iov_len = aux_buffer_sz;
+    iov[1].iov_len = buffer_pool::max_block;
     ssize_t len = readv(fd, iov, 2);
     if (len < 0) {
         return len; //indicate error
@@ -71,21 +70,48 @@ ssize_t scalable_buffer::read_fd(int fd)
     return len;
 }
 
+void scalable_buffer::compact()
+{
+    if (tail) {
+        memmove(ptr,ptr + tail,head - tail);
+        head -= tail;
+        tail = 0;
+    }
+}
+
 void scalable_buffer::clear()
 {
     tail = head = 0;
 }
 
-void scalable_buffer::copy(const scalable_buffer &oth)
+void scalable_buffer::release()
 {
-    ptr = new char[oth.len()];
-    if (!ptr) {
-        throw std::runtime_error("malloc error");
-    }
-    if (!memcpy(ptr,oth.base(),oth.len())) {
-        throw std::runtime_error("memcpy error");
+    if (ptr) {
+        buffer_pool::put(ptr,sz);
     }
+    ptr = nullptr;
+    sz = head = tail = 0;
+}
+
+void scalable_buffer::copy(const scalable_buffer &oth)
+{
     sz = oth.sz;
+    ptr = sz ? buffer_pool::get(sz) : nullptr;
+    if (oth.head) {
+        memcpy(ptr,oth.ptr,oth.head);
+    }
     head = oth.head;
     tail = oth.tail;
+}
+
+void scalable_buffer::resize()
+{
+    auto new_sz = sz < buffer_pool::max_block ? sz + 1 : static_cast<size_t>(sz * ratio);
+    auto new_ptr = buffer_pool::get(new_sz);
+    if (ptr) {
+        memcpy(new_ptr,ptr,head);
+        buffer_pool::put(ptr,sz);
+    }
+    ptr = new_ptr;
+    sz = new_sz;
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef SCALABLE_BUFFER_HH
 #define SCALABLE_BUFFER_HH
 
+#include "buffer_pool/buffer_pool.hh"
+
 #include <stdlib.h>
 #include <string.h>
 #include <sys/uio.h>
@@ -13,26 +15,30 @@
 //|_____(tail)********(head)___|
 // (extends rightward)
 //legend: _ for rubbish data(writable), * for useful data(readable), | for buffer bound
+//memory comes from buffer_pool: sizes grow along its size classes first, then by ratio
+//a buffer may go without memory, taking a block as soon as anything is to be put in
 
 class scalable_buffer
 {
 public:
-    scalable_buffer(size_t init_sz = 65536, double ratio = 1.5) : sz(init_sz < 2 ? 2 : init_sz), ratio(ratio) {
-        if ((ptr = static_cast<char *>(malloc(sz))) == nullptr) {
-            throw std::runtime_error("malloc error");
-        }
+    //no memory until needed if init_sz is 0
+    scalable_buffer(size_t init_sz = 65536, double ratio = 1.5) : sz(init_sz), ratio(ratio) {
+        ptr = sz ? buffer_pool::get(sz) : nullptr;
     }
     scalable_buffer(const scalable_buffer &oth) : ratio(oth.ratio) {
         copy(oth);
     }
     ~scalable_buffer() {
-        free(ptr);
+        release();
     }
     scalable_buffer &operator=(const scalable_buffer &oth) {
         if (ratio != oth.ratio) {
             throw std::runtime_error("scalable_buffer assignment to a different ratio!");
         }
-        copy(oth);
+        if (this != &oth) {
+            release();
+            copy(oth);
+        }
         return *this;
     }
 
@@ -52,8 +58,13 @@ public:
 
     //read from fd ONCE, returns the last result from readv()
     ssize_t read_fd(int fd);
+    //move the readable part to the front, so that the room retrieved is written again rather than the buffer growing
+    //base() moves; offsets from it stay valid
+    void compact();
     //reset
     void clear();
+    //give the memory back, dropping whatever is in
+    void release();
     //readble part ptr
     char *base() const {
         return ptr + tail;
@@ -72,16 +83,11 @@ private:
     //read offset
     size_t tail = 0;
     const double ratio;
-    static const size_t aux_buffer_sz;
 
     void copy(const scalable_buffer &oth);
-    //use the same auto-resize technology as STL vector
+    //the next size class, or beyond them, the same auto-resize technology as STL vector
     //apply MSVC2015's 1.5 as the default ratio
-    void resize() {
-        if ((ptr = static_cast<char *>(realloc(ptr,sz *= ratio))) == nullptr) {
-            throw std::runtime_error("realloc error");
-        }
-    }
+    void resize();
     //number of bytes remained available
     size_t avail() {
         return sz - head;
@@ -0,0 +1,119 @@
+#include "simd_scan.hh"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_SCAN_X86
+#endif
+
+//scalar, for the tails of vector kernels and for other CPUs
+
+static size_t crlf_scalar(const char *p,size_t len)
+{
+    for (size_t i(0); i + 1 < len; ++i) {
+        if (p[i] == '\r' && p[i + 1] == '\n') {
+            return i;
+        }
+    }
+    return len;
+}
+
+static size_t of_scalar(const char *p,size_t len,char a,char b)
+{
+    for (size_t i(0); i < len; ++i) {
+        if (p[i] == a || p[i] == b) {
+            return i;
+        }
+    }
+    return len;
+}
+
+#ifdef SIMD_SCAN_X86
+
+//a '\r' at i and a '\n' at i + 1 are tested by loading the block twice, the second one a byte later
+//so a block covers 16 possible positions but reads 17 bytes
+
+__attribute__((target("sse2")))
+static size_t crlf_sse2(const char *p,size_t len)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i(0);
+    for (; i + 17 <= len; i += 16) {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        auto y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(x,cr),_mm_cmpeq_epi8(y,lf)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + crlf_scalar(p + i,len - i);
+}
+
+__attribute__((target("sse2")))
+static size_t of_sse2(const char *p,size_t len,char a,char b)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    size_t i(0);
+    for (; i + 16 <= len; i += 16) {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x,va),_mm_cmpeq_epi8(x,vb)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + of_scalar(p + i,len - i,a,b);
+}
+
+__attribute__((target("avx2")))
+static size_t crlf_avx2(const char *p,size_t len)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i(0);
+    for (; i + 33 <= len; i += 32) {
+        auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        auto y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(x,cr),_mm256_cmpeq_epi8(y,lf)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + crlf_sse2(p + i,len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t of_avx2(const char *p,size_t len,char a,char b)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    size_t i(0);
+    for (; i + 32 <= len; i += 32) {
+        auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x,va),_mm256_cmpeq_epi8(x,vb)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + of_sse2(p + i,len - i,a,b);
+}
+
+#endif //SIMD_SCAN_X86
+
+const simd_scan::kernel_set &simd_scan::kernels()
+{
+    //picked once; thread-safe as a function local static
+    static const kernel_set picked = []() -> kernel_set {
+#ifdef SIMD_SCAN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return {crlf_avx2,of_avx2,"avx2"};
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return {crlf_sse2,of_sse2,"sse2"};
+        }
+#endif
+        return {crlf_scalar,of_scalar,"scalar"};
+    }();
+    return picked;
+}
@@ -0,0 +1,34 @@
+#ifndef SIMD_SCAN_HH
+#define SIMD_SCAN_HH
+
+#include <stddef.h>
+
+//delimiter scanning 16 or 32 bytes a time
+//the widest kernel the CPU supports (AVX2, SSE2, or plain C++) is picked by CPUID on first use
+
+class simd_scan
+{
+public:
+    //offset of the first "\r\n" in [p,p + len), or len if none
+    static size_t find_crlf(const char *p,size_t len) {
+        return kernels().crlf(p,len);
+    }
+    //offset of the first a or b in [p,p + len), or len if none
+    static size_t find_of(const char *p,size_t len,char a,char b) {
+        return kernels().of(p,len,a,b);
+    }
+    //name of the kernels picked
+    static const char *name() {
+        return kernels().name;
+    }
+
+private:
+    struct kernel_set {
+        size_t (*crlf)(const char *,size_t);
+        size_t (*of)(const char *,size_t,char,char);
+        const char *name;
+    };
+    static const kernel_set &kernels();
+};
+
+#endif //SIMD_SCAN_HH
@@ -0,0 +1,145 @@
+#include "task_queue.hh"
+
+using namespace std;
+
+task_ring::task_ring(size_t size)
+    : ring_size(size),
+    ring(new cell[size])
+{
+    //cell i is free for the producer claiming position i in the first lap
+    for (size_t i(0); i < ring_size; ++i) {
+        ring[i].seq.store(i,memory_order_relaxed);
+    }
+}
+
+bool task_ring::push(small_task &&task,size_t limit)
+{
+    cell *c;
+    auto pos = enqueue_pos.load(memory_order_relaxed);
+    while (true) {
+        //the dequeue position read may be behind, which only makes the queue look fuller
+        if (pos - dequeue_pos.load(memory_order_acquire) >= limit) {
+            return false;
+        }
+        c = &ring[pos % ring_size];
+        auto seq = c->seq.load(memory_order_acquire);
+        auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        //free in this lap; claim it
+        if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos,pos + 1,memory_order_relaxed)) {
+                break;
+            }
+        }
+        //claimed by another producer, or, as there's room, still being read by a consumer of the last lap
+        else {
+            pos = enqueue_pos.load(memory_order_relaxed);
+        }
+    }
+    c->task = move(task);
+    //publish to consumers
+    c->seq.store(pos + 1,memory_order_release);
+    return true;
+}
+
+bool task_ring::pop(small_task &task)
+{
+    cell *c;
+    auto pos = dequeue_pos.load(memory_order_relaxed);
+    while (true) {
+        c = &ring[pos % ring_size];
+        auto seq = c->seq.load(memory_order_acquire);
+        auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        //published in this lap; claim it
+        if (diff == 0) {
+            if (dequeue_pos.compare_exchange_weak(pos,pos + 1,memory_order_relaxed)) {
+                break;
+            }
+        }
+        //empty
+        else if (diff < 0) {
+            return false;
+        }
+        //claimed by another consumer
+        else {
+            pos = dequeue_pos.load(memory_order_relaxed);
+        }
+    }
+    task = move(c->task);
+    c->task = nullptr;
+    //free for the producer of the next lap
+    c->seq.store(pos + ring_size,memory_order_release);
+    return true;
+}
+
+//orderings follow "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al., 2013)
+
+task_deque::task_deque(size_t capacity)
+    : mask(capacity - 1),
+    slots(new atomic<small_task *>[capacity])
+{
+}
+
+task_deque::~task_deque()
+{
+    small_task task;
+    while (pop(task)) {
+    }
+}
+
+bool task_deque::push(small_task &&task)
+{
+    auto b = bottom.load(memory_order_relaxed);
+    auto t = top.load(memory_order_acquire);
+    if (b - t > static_cast<int64_t>(mask)) {
+        return false;
+    }
+    slots[b & mask].store(new small_task(move(task)),memory_order_relaxed);
+    //publish to thieves
+    bottom.store(b + 1,memory_order_release);
+    return true;
+}
+
+bool task_deque::pop(small_task &task)
+{
+    auto b = bottom.load(memory_order_relaxed) - 1;
+    bottom.store(b,memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    auto t = top.load(memory_order_relaxed);
+    if (t > b) {
+        //empty
+        bottom.store(b + 1,memory_order_relaxed);
+        return false;
+    }
+    auto p = slots[b & mask].load(memory_order_relaxed);
+    //the last one; race thieves for it
+    if (t == b) {
+        if (!top.compare_exchange_strong(t,t + 1,memory_order_seq_cst,memory_order_relaxed)) {
+            p = nullptr;
+        }
+        bottom.store(b + 1,memory_order_relaxed);
+    }
+    if (!p) {
+        return false;
+    }
+    task = move(*p);
+    delete p;
+    return true;
+}
+
+bool task_deque::steal(small_task &task)
+{
+    auto t = top.load(memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    auto b = bottom.load(memory_order_acquire);
+    if (t >= b) {
+        return false;
+    }
+    auto p = slots[t & mask].load(memory_order_relaxed);
+    //lost to the owner or another thief
+    if (!top.compare_exchange_strong(t,t + 1,memory_order_seq_cst,memory_order_relaxed)) {
+        return false;
+    }
+    task = move(*p);
+    delete p;
+    return true;
+}
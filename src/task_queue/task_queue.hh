@@ -0,0 +1,158 @@
+#ifndef TASK_QUEUE_HH
+#define TASK_QUEUE_HH
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <new>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+//move-only callable stored in place, so that handing a task over allocates nothing and copies nothing
+//anything larger than capacity, or aligned more than a pointer, goes to the heap, like std::function does
+class small_task
+{
+public:
+    static const size_t capacity = 48;
+
+    small_task() = default;
+    small_task(std::nullptr_t) {}
+    template <typename F,typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type,small_task>::value>::type>
+    small_task(F &&f) {
+        using T = typename std::decay<F>::type;
+        if constexpr (sizeof(T) <= capacity && alignof(T) <= alignof(void *)) {
+            new (buf) T(std::forward<F>(f));
+            ops = &inline_ops<T>;
+        }
+        else {
+            *reinterpret_cast<T **>(buf) = new T(std::forward<F>(f));
+            ops = &heap_ops<T>;
+        }
+    }
+    small_task(small_task &&other) noexcept {
+        take(other);
+    }
+    small_task &operator=(small_task &&other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+    small_task &operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+    small_task(const small_task &) = delete;
+    small_task &operator=(const small_task &) = delete;
+    ~small_task() {
+        reset();
+    }
+    void operator()() {
+        ops->invoke(buf);
+    }
+    explicit operator bool() const {
+        return ops;
+    }
+
+private:
+    struct op_table {
+        void (*invoke)(void *);
+        //move-construct into dst, and destroy what's left in src
+        void (*relocate)(void *dst,void *src);
+        void (*destroy)(void *);
+    };
+    template <typename T>
+    static constexpr op_table inline_ops = {
+        [](void *p) { (*static_cast<T *>(p))(); },
+        [](void *dst,void *src) { new (dst) T(std::move(*static_cast<T *>(src))); static_cast<T *>(src)->~T(); },
+        [](void *p) { static_cast<T *>(p)->~T(); }
+    };
+    template <typename T>
+    static constexpr op_table heap_ops = {
+        [](void *p) { (**static_cast<T **>(p))(); },
+        [](void *dst,void *src) { *static_cast<T **>(dst) = *static_cast<T **>(src); },
+        [](void *p) { delete *static_cast<T **>(p); }
+    };
+
+    //pointer aligned only, which keeps a task and a sequence number in one cache line
+    alignas(void *) unsigned char buf[capacity];
+    const op_table *ops = nullptr;
+
+    void take(small_task &other) {
+        if (other.ops) {
+            other.ops->relocate(buf,other.buf);
+            ops = other.ops;
+            other.ops = nullptr;
+        }
+    }
+    void reset() {
+        if (ops) {
+            ops->destroy(buf);
+            ops = nullptr;
+        }
+    }
+};
+
+//lock-free containers of tasks for thread_pool
+
+//bounded MPMC ring (Dmitry Vyukov's): every cell carries a sequence number
+//telling whether it's ready to be written or read in the current lap
+class task_ring
+{
+public:
+    explicit task_ring(size_t size);
+    //false if limit tasks are queued already; limit must not exceed size
+    bool push(small_task &&task,size_t limit);
+    bool pop(small_task &task);
+    //just hints, as tasks may be pushed or popped meanwhile
+    size_t size() const {
+        return enqueue_pos.load(std::memory_order_relaxed) - dequeue_pos.load(std::memory_order_relaxed);
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+
+private:
+    //a cache line each
+    struct alignas(64) cell {
+        std::atomic<size_t> seq;
+        small_task task;
+    };
+    size_t ring_size;
+    std::unique_ptr<cell[]> ring;
+    //producers and consumers claim cells by these, each in a cache line of its own
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+};
+
+//bounded Chase-Lev deque: the owner thread pushes and pops at the bottom, LIFO; other threads steal at the top, FIFO
+//slots hold pointers, so a thief losing the race for a slot has read nothing but a pointer
+//which makes a task pushed here the one allocation on the way
+class task_deque
+{
+public:
+    //capacity must be a power of 2
+    explicit task_deque(size_t capacity);
+    ~task_deque();
+    //owner only; false if full
+    bool push(small_task &&task);
+    //owner only
+    bool pop(small_task &task);
+    //any thread
+    bool steal(small_task &task);
+    bool empty() const {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+
+private:
+    size_t mask;
+    std::unique_ptr<std::atomic<small_task *>[]> slots;
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+};
+
+#endif //TASK_QUEUE_HH
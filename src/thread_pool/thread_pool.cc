@@ -1,18 +1,26 @@
 #include "thread_pool.hh"
 
-thread_pool::thread_pool(size_t nthreads,size_t max_queue_capacity)
+//which pool and worker the calling thread is, if any
+static thread_local thread_pool *self_pool = nullptr;
+static thread_local size_t self_index;
+
+thread_pool::thread_pool(size_t nthreads,size_t max_queue_capacity,bool work_stealing,const std::vector<cpu_set_t> &masks)
     : nthreads(nthreads),
     workers(std::vector<pthread_t>(nthreads)),
-    max_queue_capacity(max_queue_capacity)
+    max_queue_capacity(max_queue_capacity),
+    work_stealing(work_stealing),
+    spin_count(sysconf(_SC_NPROCESSORS_ONLN) > 1 ? max_spin : 0),
+    masks(masks),
+    inbox_capacity(std::max(max_queue_capacity / std::max(nthreads,static_cast<size_t>(1)),static_cast<size_t>(1)))
 {
-    if (pthread_mutex_init(&mutex,nullptr) < 0) {
-        throw std::runtime_error("pthread_mutex_init error");
-    }
-    if (pthread_cond_init(&cond,nullptr) < 0) {
-        throw std::runtime_error("pthread_cond_init error");
+    if (work_stealing) {
+        //one more cell in each inbox for the task injected by block_with()
+        for (size_t i(0); i < nthreads; ++i) {
+            slots.emplace_back(new worker(inbox_capacity + 1));
+        }
     }
-    if (pthread_mutex_init(&counter_mtx,nullptr) < 0) {
-        throw std::runtime_error("pthread_mutex_init error");
+    else {
+        queue.reset(new task_ring(max_queue_capacity + nthreads));
     }
     //thread creation
     //run in detach state
@@ -28,92 +36,259 @@ thread_pool::thread_pool(size_t nthreads,size_t max_queue_capacity)
             throw std::runtime_error("pthread_create error");
         }
     }
+    //so that unpinned() is final
+    while (!masks.empty() && n_placed.load(std::memory_order_acquire) < nthreads) {
+        sched_yield();
+    }
 }
 
 thread_pool::~thread_pool()
 {
     //block until threads are killed
     block_with(std::bind(&thread_pool::exiter,this),nthreads);
-    //destroy posix objects
-    pthread_cond_destroy(&cond);
-    pthread_mutex_destroy(&mutex);
-    pthread_mutex_destroy(&counter_mtx);
 }
 
 void thread_pool::block()
 {
-    block_with(std::bind(&thread_pool::detector,this),1);
+    //every inbox is gone through when work stealing
+    block_with(std::bind(&thread_pool::detector,this),work_stealing ? nthreads : 1);
 }
 
 void thread_pool::block_with(std::function<void ()> f,size_t num_to_block)
 {
-    counter = 0;    //assume block_with() is called within only one thread, so no mutex needed now
-    max_queue_capacity += num_to_block; //ensure queue capacity
+    counter.store(0,std::memory_order_relaxed);    //assume block_with() is called within only one thread
     for (int i(0); i < num_to_block; ++i) {
-        push(f);    //inject detecting staffs
+        //inject detecting staffs; the room beyond max_queue_capacity is kept for them
+        while (!(work_stealing ? push_inbox(i % nthreads,small_task(f),inbox_capacity + 1)
+                : push_shared(small_task(f),max_queue_capacity + nthreads))) {
+            sched_yield();
+        }
     }
     //detect
-    while (true) {
-        pthread_mutex_lock(&counter_mtx);
-        if (counter == num_to_block) {
-            pthread_mutex_unlock(&counter_mtx);
-            break;
-        }
-        pthread_mutex_unlock(&counter_mtx);
+    while (counter.load(std::memory_order_acquire) != num_to_block) {
         sleep(1);
     }
-    //restore queue capacity
-    max_queue_capacity -= num_to_block;
 }
 
 using namespace std;
-bool thread_pool::push(const std::function<void ()> &task)
-{
-    pthread_t tid = pthread_self();
-    dbg("acquiring lock " + to_string(tid));
-    pthread_mutex_lock(&mutex);
-    dbg("lock acquired " + to_string(tid));
-    if (queue.size() >= max_queue_capacity) {   //queue's size can be greater than max size when preprocess is not empty
-        dbg("queue full " + to_string(tid));
-        pthread_mutex_unlock(&mutex);
-        dbg("lock released " + to_string(tid));
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+bool thread_pool::push(small_task &&task)
+{
+    if (!work_stealing) {
+        return push_shared(move(task),max_queue_capacity);
+    }
+    if (self_pool == this) {
+        if (slots[self_index]->deque.push(move(task))) {
+            //the worker is busy with the task pushing this one
+            wake_thief();
+            return true;
+        }
+        //deque full; the task is still there
+        return push_inbox(self_index,move(task),inbox_capacity);
+    }
+    return push_inbox(next.fetch_add(1,memory_order_relaxed) % nthreads,move(task),inbox_capacity);
+}
+
+bool thread_pool::push(small_task &&task,size_t affinity)
+{
+    if (!work_stealing || self_pool == this) {
+        return push(move(task));
+    }
+    return push_inbox(affinity % nthreads,move(task),inbox_capacity);
+}
+
+bool thread_pool::push_shared(small_task &&task,size_t limit)
+{
+    if (!queue->push(move(task),limit)) {
+        dbg("queue full");
         return false;
     }
-    dbg("about to push into queue " + to_string(tid));
-    queue.push(task);
-    dbg("pushed " + to_string(tid));
-    pthread_mutex_unlock(&mutex);
-    dbg("lock released " + to_string(tid));
-    pthread_cond_signal(&cond);
-    dbg("cond signaled " + to_string(tid));
+    //pairs with the fence in wait_for(): either a worker about to park sees the task, or it's seen parking here
+    atomic_thread_fence(memory_order_seq_cst);
+    if (park.n_parked.load(memory_order_relaxed)) {
+        wake(park,1);
+    }
     return true;
 }
 
+bool thread_pool::push_inbox(size_t i,small_task &&task,size_t limit)
+{
+    auto &w = *slots[i];
+    if (!w.inbox.push(move(task),limit)) {
+        dbg("inbox full");
+        return false;
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if (w.park.n_parked.load(memory_order_relaxed)) {
+        wake(w.park,1);
+    }
+    //the owner is busy and the task has to wait; let an idle worker have it
+    else if (w.inbox.size() > 1) {
+        wake_thief();
+    }
+    return true;
+}
+
+void thread_pool::wake_thief()
+{
+    if (!park.n_parked.load(memory_order_relaxed)) {
+        return;
+    }
+    auto start = next.load(memory_order_relaxed);
+    for (size_t k(0); k < nthreads; ++k) {
+        auto &w = *slots[(start + k) % nthreads];
+        if (w.park.n_parked.load(memory_order_relaxed)) {
+            wake(w.park,1);
+            return;
+        }
+    }
+}
+
+bool thread_pool::empty() const
+{
+    if (!work_stealing) {
+        return queue->empty();
+    }
+    for (auto &w : slots) {
+        if (!w->inbox.empty() || !w->deque.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void thread_pool::broadcast()
+{
+    if (!work_stealing) {
+        wake(park,INT_MAX);
+        return;
+    }
+    for (auto &w : slots) {
+        wake(w->park,INT_MAX);
+    }
+}
+
+bool thread_pool::pin(const cpu_set_t &mask)
+{
+    bool ok = true;
+    for (auto tid : workers) {
+        ok = cpu_topology::pin(tid,mask) && ok;
+    }
+    return ok;
+}
+
+void thread_pool::wait_for(small_task &task)
+{
+    while (true) {
+        for (int i(0); i < spin_count; ++i) {
+            if (queue->pop(task)) {
+                return;
+            }
+            cpu_relax();
+        }
+        //announce parking before the last try, so that a producer pushing after it is bound to wake us
+        park.n_parked.fetch_add(1,memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        auto e = park.epoch.load(memory_order_relaxed);
+        if (queue->pop(task)) {
+            park.n_parked.fetch_sub(1,memory_order_relaxed);
+            return;
+        }
+        park_on(park,e);
+        park.n_parked.fetch_sub(1,memory_order_relaxed);
+    }
+}
+
+void thread_pool::wait_for(size_t i,small_task &task)
+{
+    auto &w = *slots[i];
+    while (true) {
+        for (int k(0); k < spin_count; ++k) {
+            if (find_task(i,task)) {
+                return;
+            }
+            cpu_relax();
+        }
+        //same as above, parking on its own word so that its inbox wakes it up only
+        //the pool wide count tells producers of other workers if there's anyone to steal
+        w.park.n_parked.fetch_add(1,memory_order_relaxed);
+        park.n_parked.fetch_add(1,memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        auto e = w.park.epoch.load(memory_order_relaxed);
+        bool found = find_task(i,task);
+        if (!found) {
+            park_on(w.park,e);
+        }
+        park.n_parked.fetch_sub(1,memory_order_relaxed);
+        w.park.n_parked.fetch_sub(1,memory_order_relaxed);
+        if (found) {
+            return;
+        }
+    }
+}
+
+bool thread_pool::find_task(size_t i,small_task &task)
+{
+    auto &w = *slots[i];
+    if (w.deque.pop(task) || w.inbox.pop(task)) {
+        return true;
+    }
+    for (size_t k(1); k < nthreads; ++k) {
+        auto &v = *slots[(i + k) % nthreads];
+        if (v.inbox.pop(task) || v.deque.steal(task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void thread_pool::park_on(parking &p,int epoch)
+{
+    //returns at once if epoch has moved on since read
+    syscall(SYS_futex,&p.epoch,FUTEX_WAIT_PRIVATE,epoch,nullptr,nullptr,0);   //cancellation point
+}
+
+void thread_pool::wake(parking &p,int n)
+{
+    p.epoch.fetch_add(1,memory_order_release);
+    syscall(SYS_futex,&p.epoch,FUTEX_WAKE_PRIVATE,n,nullptr,nullptr,0);
+}
+
 void *thread_pool::thrd_fn(void *arg)
 {
-    pthread_t tid = pthread_self();
     auto p = static_cast<thread_pool *>(arg);
+    size_t i = p->n_started.fetch_add(1,memory_order_relaxed);
+    if (i < p->masks.size() && !cpu_topology::pin_self(p->masks[i])) {
+        log_err("failed to pin worker " + to_string(i));
+        p->n_unpinned.fetch_add(1,memory_order_relaxed);
+    }
+    p->n_placed.fetch_add(1,memory_order_release);
+    if (p->work_stealing) {
+        self_pool = p;
+        self_index = i;
+    }
+    small_task task;
     while (true) {
         pthread_testcancel();   //cancellation point
-        dbg("worker acquiring lock " + to_string(tid));
-        pthread_mutex_lock(&p->mutex);
-        dbg("worker lock acquired " + to_string(tid));
-        while (p->empty()) {
-            dbg("worker wait for cond " + to_string(tid));
-            pthread_cond_wait(&p->cond,&p->mutex);  //cancellation point
+        if (p->work_stealing) {
+            p->wait_for(i,task);
         }
-        dbg("worker ensure q not empty " + to_string(tid));
-        auto task = p->queue.front();
-        p->queue.pop();
-        dbg("worker fetch task " + to_string(tid));
-        pthread_mutex_unlock(&p->mutex);
-        dbg("worker released lock " + to_string(tid));
+        else {
+            p->wait_for(task);
+        }
+        dbg("worker fetch task");
 
         pthread_testcancel();   //cancellation point
         //process
-        dbg("worker about to work " + to_string(tid));
         task();
-        dbg("worker work done. " + to_string(tid));
+        task = nullptr;
+        dbg("worker work done.");
     }
     return nullptr;  //dummy return
 }
@@ -127,7 +302,5 @@ void thread_pool::exiter()
 
 void thread_pool::detector()
 {
-    pthread_mutex_lock(&counter_mtx);
-    ++counter;
-    pthread_mutex_unlock(&counter_mtx);
-}
\ No newline at end of file
+    counter.fetch_add(1,memory_order_release);
+}
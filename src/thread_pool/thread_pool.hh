@@ -1,12 +1,21 @@
 #ifndef THREAD_POOL_HH
 #define THREAD_POOL_HH
 
+#include "task_queue/task_queue.hh"
+#include "cpu_topology/cpu_topology.hh"
+#include "logger/logger.hh"
+
 #include <stdlib.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 #include <iostream>
-#include <queue>
 #include <vector>
+#include <memory>
+#include <atomic>
 #include <stdexcept>
 #include <functional>
 
@@ -15,46 +24,97 @@
 #include <dbg.h>
 #include <string>
 
+//two scheduling modes:
+//shared queue: all tasks go through one lock-free bounded MPMC ring
+//work stealing: each worker owns an inbox ring, fed by other threads by affinity, and a Chase-Lev deque for the tasks it pushes itself
+//a worker short of tasks steals from the others' inboxes and deques
+//either way, idle workers spin a while before parking on a futex, and producers make the wake-up syscall only if someone is parked
+
 class thread_pool
 {
 public:
-    thread_pool(size_t nthreads = 16,size_t max_queue_capacity = 65536);
+    //worker i pins itself to masks[i], if given, before taking any task; the constructor returns once all have tried
+    thread_pool(size_t nthreads = 16,size_t max_queue_capacity = 65536,bool work_stealing = false,const std::vector<cpu_set_t> &masks = {});
     ~thread_pool();
-    bool push(const std::function<void ()> &task);
-    bool push(std::function<void ()> &&task) {
-        return push(task);
-    }
-    //when called with mutex lock acquired, like thrd_fn() does, the result is accurate
-    //when called without lock acquired, it's just a hint
-    bool empty() const {
-        return queue.empty();
-    }
+    //false if the queue is full, and task is left as it was, so that the caller may run it itself
+    //when work stealing, max_queue_capacity is divided evenly among the inboxes
+    //anything callable, std::function included, converts to small_task, which is moved along from here on
+    bool push(small_task &&task);
+    //when work stealing, tasks of the same affinity go to the same worker, unless stolen
+    //a task pushed by a worker goes to its own deque whatever the affinity
+    bool push(small_task &&task,size_t affinity);
+    //just a hint, as tasks may be pushed or popped meanwhile
+    bool empty() const;
     size_t thread_num() const {
         return workers.size();
     }
+    //workers whose pinning failed; also logged as they fail, which is lost if the logger isn't set up yet
+    size_t unpinned() const {
+        return n_unpinned.load(std::memory_order_relaxed);
+    }
     //block until all tasks currently in the queue are done
     //if user push tasks asynchronously (i.e. pushing tasks in thread(s) other than the thread(s) calling block()), the tasks waited may differ than those when block() is called due to thread scheduling
     void block();
-    void broadcast() {
-        pthread_cond_broadcast(&cond);
-    }
+    //wake up every parked worker
+    void broadcast();
+    //pin every worker to mask; false on failure
+    bool pin(const cpu_set_t &mask);
 
 private:
+    //pops tried before a worker parks; no use spinning on a single CPU, where the producer can't run meanwhile
+    static const int max_spin = 128;
+    //tasks a worker may push into its own deque
+    static const size_t deque_capacity = 256;
+
+    //eventcount: bumped on every wake-up, so a worker about to park can tell if it missed one
+    struct alignas(64) parking {
+        std::atomic<int> epoch{0};
+        std::atomic<int> n_parked{0};
+    };
+    struct alignas(64) worker {
+        explicit worker(size_t inbox_size) : inbox(inbox_size),deque(deque_capacity) {}
+        task_ring inbox;    //<tasks pushed by other threads
+        task_deque deque;   //<tasks pushed by the worker itself
+        parking park;
+    };
+
     size_t nthreads;
     std::vector<pthread_t> workers;
-    std::queue<std::function<void ()>> queue;
     size_t max_queue_capacity;
-    //for queue
-    pthread_mutex_t mutex;
-    pthread_cond_t cond;
+    bool work_stealing;
+    int spin_count;
+    std::vector<cpu_set_t> masks;
+    //shared queue mode
+    //max_queue_capacity, plus room for the tasks injected by block_with()
+    std::unique_ptr<task_ring> queue;
+    parking park;
+    //work stealing mode
+    size_t inbox_capacity;
+    std::vector<std::unique_ptr<worker>> slots;
+    std::atomic<size_t> next{0};        //<for tasks without affinity
+    std::atomic<size_t> n_started{0};   //<gives workers their indexes
+    std::atomic<size_t> n_placed{0};    //<workers done with pinning
+    std::atomic<size_t> n_unpinned{0};
 
-    size_t counter;
-    pthread_mutex_t counter_mtx; //for n_exit
+    std::atomic<size_t> counter{0};
     void detector();
     void exiter();
     void block_with(std::function<void ()> f,size_t num_to_block);
 
+    //push into the shared queue, or the inbox of worker i, waking up whoever may take it
+    bool push_shared(small_task &&task,size_t limit);
+    bool push_inbox(size_t i,small_task &&task,size_t limit);
+    //wake up a parked worker, if any, to steal
+    void wake_thief();
+    //get a task, spinning and then parking until there's one
+    void wait_for(small_task &task);
+    void wait_for(size_t i,small_task &task);
+    //own deque, own inbox, then those of the others
+    bool find_task(size_t i,small_task &task);
+    static void park_on(parking &p,int epoch);
+    static void wake(parking &p,int n);
+
     static void *thrd_fn(void *arg);
 };
 
-#endif //THREAD_POOL_HH
\ No newline at end of file
+#endif //THREAD_POOL_HH
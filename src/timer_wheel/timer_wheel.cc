@@ -0,0 +1,101 @@
+#include "timer_wheel.hh"
+
+using namespace std;
+
+timer_wheel::timer_wheel(uint64_t tick_ms,size_t nslots)
+    : slots(nslots < 1 ? 1 : nslots,npos),
+    tick_ms(tick_ms < 1 ? 1 : tick_ms),
+    current(0),
+    start_ms(now_ms())
+{
+}
+
+timer_wheel::handle timer_wheel::add(uint64_t key,uint64_t timeout_ms)
+{
+    handle h;
+    if (free_list != npos) {
+        h = free_list;
+        free_list = nodes[h].next;
+    }
+    else {
+        h = nodes.size();
+        nodes.emplace_back();
+    }
+    nodes[h].key = key;
+    nodes[h].expire_tick = ticks_from_now(timeout_ms);
+    link(h);
+    ++n_timer;
+    return h;
+}
+
+void timer_wheel::refresh(handle h,uint64_t timeout_ms)
+{
+    unlink(h);
+    nodes[h].expire_tick = ticks_from_now(timeout_ms);
+    link(h);
+}
+
+void timer_wheel::cancel(handle h)
+{
+    unlink(h);
+    nodes[h].next = free_list;
+    free_list = h;
+    --n_timer;
+}
+
+void timer_wheel::advance(const function<void (uint64_t)> &on_expire)
+{
+    auto target = (now_ms() - start_ms) / tick_ms;
+    //a full revolution visits every slot
+    if (target - current > slots.size()) {
+        current = target - slots.size();
+    }
+    expired.clear();
+    while (current < target) {
+        ++current;
+        auto h = slots[current % slots.size()];
+        while (h != npos) {
+            auto next = nodes[h].next;
+            if (nodes[h].expire_tick <= current) {
+                expired.push_back(nodes[h].key);
+                cancel(h);
+            }
+            h = next;
+        }
+    }
+    for (auto key : expired) {
+        on_expire(key);
+    }
+}
+
+uint64_t timer_wheel::ticks_from_now(uint64_t timeout_ms) const
+{
+    //round up, and never into the slot being visited
+    auto t = (now_ms() - start_ms + timeout_ms + tick_ms - 1) / tick_ms;
+    return t > current ? t : current + 1;
+}
+
+void timer_wheel::link(handle h)
+{
+    auto &head = slots[nodes[h].expire_tick % slots.size()];
+    nodes[h].prev = npos;
+    nodes[h].next = head;
+    if (head != npos) {
+        nodes[head].prev = h;
+    }
+    head = h;
+}
+
+void timer_wheel::unlink(handle h)
+{
+    auto &n = nodes[h];
+    if (n.prev != npos) {
+        nodes[n.prev].next = n.next;
+    }
+    else {
+        slots[n.expire_tick % slots.size()] = n.next;
+    }
+    if (n.next != npos) {
+        nodes[n.next].prev = n.prev;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef TIMER_WHEEL_HH
+#define TIMER_WHEEL_HH
+
+#include <stdint.h>
+#include <time.h>
+
+#include <vector>
+#include <functional>
+
+//hashed timing wheel: a timer lives in slot (expire tick % number of slots), and is checked once per revolution until due
+//add, refresh and cancel are O(1); advancing one tick costs the length of one slot
+//not thread-safe; every reactor owns one and drives it from its loop thread
+
+class timer_wheel
+{
+public:
+    using handle = uint32_t;
+    static constexpr handle npos = ~0u;
+
+    timer_wheel(uint64_t tick_ms = 100,size_t nslots = 512);
+    //key is passed back when the timer expires
+    handle add(uint64_t key,uint64_t timeout_ms);
+    //expire timeout_ms from now instead
+    void refresh(handle h,uint64_t timeout_ms);
+    void cancel(handle h);
+    //move on to now, calling on_expire with key of every timer due
+    //expired timers are removed before on_expire is called, so it can add, refresh or cancel timers freely
+    void advance(const std::function<void (uint64_t key)> &on_expire);
+    size_t size() const {
+        return n_timer;
+    }
+    uint64_t tick() const {
+        return tick_ms;
+    }
+    //monotonic clock in ms
+    static uint64_t now_ms() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC,&ts);
+        return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+    }
+
+private:
+    struct node {
+        uint64_t key;
+        uint64_t expire_tick;
+        handle prev;
+        handle next;    //<next free node if not in use
+    };
+    std::vector<node> nodes;
+    handle free_list = npos;
+    std::vector<handle> slots;  //<head of each slot
+    uint64_t tick_ms;
+    uint64_t current;   //<ticks passed
+    uint64_t start_ms;
+    size_t n_timer = 0;
+    std::vector<uint64_t> expired;  //<reused by advance()
+
+    uint64_t ticks_from_now(uint64_t timeout_ms) const;
+    void link(handle h);
+    void unlink(handle h);
+};
+
+#endif //TIMER_WHEEL_HH
@@ -9,7 +9,7 @@ static auto blocked_sigset = [](){
         log_err("sigemptyset failed");
         throw runtime_error("sigemptyset error");
     }
-    if (sigaddset(&set,SIGALRM) < 0 || sigaddset(&set,SIGINT) < 0 || sigaddset(&set,SIGQUIT) < 0) {
+    if (sigaddset(&set,SIGINT) < 0 || sigaddset(&set,SIGQUIT) < 0) {
         log_err("sigaddset failed");
         throw runtime_error("sigaddset error");
     }
@@ -20,37 +20,109 @@ static auto blocked_sigset = [](){
     return set;
 }();
 
-expirer<shared_ptr<http_conn>,webserver::http_conn_ptr_hasher> webserver::timer;
+bool webserver::worker_process = false;
 
 webserver::webserver(
     unsigned port,
     bool listen_ET,
     bool conn_ET,
     size_t max_event,
+    event_backend::type backend,
     int backlog,
     std::string root,
     const std::set<std::string> &index_pages,
+    bool use_sendfile,
+    size_t file_cache_capacity,
+    size_t small_file_limit,
+    size_t small_file_memory,
     size_t max_connection,
     size_t accept_thread_num,
-    size_t livetime_s,
-    size_t check_interval_s,
+    size_t reactor_num,
+    balance_policy balance,
+    bool reuseport,
+    dispatch_mode mode,
+    size_t inline_write_limit,
+    size_t livetime_ms,
+    size_t header_timeout_ms,
+    size_t body_timeout_ms,
+    size_t write_timeout_ms,
+    size_t tick_ms,
     bool enable_logger,
     logger::log_level log_level,
     std::string log_path,
     bool log_async,
-    size_t log_queue_capacity,
+    size_t log_ring_size,
     size_t nthreads,
-    size_t thread_pool_queue_capacity
+    size_t thread_pool_queue_capacity,
+    bool work_stealing,
+    affinity_policy affinity,
+    size_t shed_delay_ms
 ) : port(port),
-    ep(max_event),
-    backlog(backlog),
-    root(root),
-    index_pages(index_pages),
+    conf{root,index_pages},
+    main_reactor(0,max_event,backend,tick_ms,bind(&webserver::dispatch,this,placeholders::_1,placeholders::_2),bind(&webserver::expire_handler,this,placeholders::_1,placeholders::_2)),
+    balance(balance),
+    affinity(affinity),
+    mode(mode),
+    inline_write_limit(inline_write_limit),
+    tp(nthreads,thread_pool_queue_capacity,work_stealing,worker_masks(affinity,reactor_num,nthreads)),
     max_connection(max_connection),
+    backlog(backlog),
     accept_thread_num(accept_thread_num),
-    tp(nthreads,thread_pool_queue_capacity)
+    livetime_ms(livetime_ms),
+    header_timeout_ms(header_timeout_ms),
+    body_timeout_ms(body_timeout_ms),
+    write_timeout_ms(write_timeout_ms),
+    shed_delay_us(shed_delay_ms * 1000),
+    busy_response(http_response::canned(503)),
+    reuseport(reuseport || worker_process)
 {
-    //dedicate another thread fro SIGALRM handling
+    for (size_t i(1); i <= reactor_num; ++i) {
+        sub_reactors.emplace_back(new reactor(i,max_event,backend,tick_ms,bind(&webserver::dispatch,this,placeholders::_1,placeholders::_2),bind(&webserver::expire_handler,this,placeholders::_1,placeholders::_2)));
+    }
+    for (size_t i(0); i <= reactor_num; ++i) {
+        conn_pools.emplace_back(new conn_pool(conf));
+    }
+    loop_lag_us.reset(new atomic<uint32_t>[reactor_num + 1]());
+    //reactors take the first slots, the main one first; working threads pin themselves
+    int node = 0;
+    if (affinity != FLOATING) {
+        auto mask = placement(affinity,0,node);
+        main_reactor.set_affinity(mask,node);
+        //where INCOMING_CPU looks reactors up by the CPU a connection comes in through
+        node_reactors.resize(cpu_topology::nodes());
+        for (auto &r : sub_reactors) {
+            mask = placement(affinity,r->id(),node);
+            r->set_affinity(mask,node);
+            if (r->cpu() >= 0) {
+                if (static_cast<size_t>(r->cpu()) >= cpu_reactor.size()) {
+                    cpu_reactor.resize(r->cpu() + 1);
+                }
+                cpu_reactor[r->cpu()] = r.get();
+            }
+            node_reactors[node].push_back(r.get());
+        }
+        node_workers.resize(cpu_topology::nodes());
+        for (size_t i(0); i < nthreads; ++i) {
+            placement(affinity,reactor_num + 1 + i,node);
+            node_workers[node].push_back(i);
+        }
+    }
+    if (pthread_mutex_init(&accept_mutex,nullptr) < 0) {
+        throw runtime_error("pthread_mutex_init error");
+    }
+    for (auto &r : sub_reactors) {
+        r->set_tick_handler(bind(&webserver::lag_tick,this,placeholders::_1));
+    }
+    main_reactor.set_tick_handler([this](reactor &r) {
+        lag_tick(r);
+        overload_tick();
+    });
+    //a peer gone while being written to fails the write with EPIPE instead of killing the process
+    if (signal(SIGPIPE,SIG_IGN) == SIG_ERR) {
+        log_err("ignoring SIGPIPE failed");
+        throw runtime_error("signal error");
+    }
+    //dedicate another thread for SIGINT/SIGQUIT handling
     pthread_attr_t attr;
     if (pthread_attr_init(&attr) < 0) {
         throw std::runtime_error("pthread_attr_init error");
@@ -62,18 +134,30 @@ webserver::webserver(
     if (pthread_create(&tid,&attr,signal_handler_thrd_fn,this) < 0) {
         throw std::runtime_error("pthread_create error");
     }
-    //set timer
-    timer = expirer<shared_ptr<http_conn>,http_conn_ptr_hasher>(livetime_s,check_interval_s);
-    //alarm
-    expirer<http_conn *,http_conn_ptr_hasher>::set_alarm(check_interval_s);
-
+    if (affinity != FLOATING) {
+        placement(PIN_NODE,0,node);
+        cpu_topology::pin(tid,cpu_topology::node_mask(node));
+    }
     //set http connection trigger mode
     http_conn::set_trigger(conn_ET);
+    //set how files are sent
+    http_response::set_sendfile(use_sendfile);
+    //tell clients how long idle connections are kept
+    http_response::set_keep_alive(livetime_ms / 1000);
+    //cache files under root
+    if (file_cache_capacity) {
+        files.reset(new file_cache(root,file_cache_capacity,use_sendfile,small_file_limit,small_file_memory));
+        http_response::set_file_cache(files.get());
+    }
     //set default epoll event mask
     init_event_mask(listen_ET,conn_ET);
-    //set logger with logging thread SIGALRM blocked if async is true
+    //set logger with logging thread signals blocked if async is true
     if (enable_logger) {
-        logger::instance()->init(log_path,log_level,log_async,log_queue_capacity);
+        logger::instance()->init(log_path,log_level,log_async,log_ring_size);
+        if (affinity != FLOATING) {
+            placement(PIN_NODE,0,node);
+            logger::instance()->pin(cpu_topology::node_mask(node));
+        }
     }
 
     //log
@@ -81,7 +165,7 @@ webserver::webserver(
     log_info("webserver listening at " + to_string(port));
     log_info("listen fd trigger mode: " + string(listen_ET ? "ET" : "LT"));
     log_info("client fd trigger mode: " + string(conn_ET ? "ET" : "LT"));
-    log_info("max_event = " + to_string(max_event) + ", epoll_wait backlog = " + to_string(backlog));
+    log_info("max_event = " + to_string(max_event) + ", event backend = " + main_reactor.poller().name() + ", listen backlog = " + to_string(backlog));
     log_info("root directory = " + root);
     string stridxpage;
     for (auto &p : index_pages) {
@@ -90,96 +174,318 @@ webserver::webserver(
     stridxpage.pop_back();
     stridxpage.pop_back();
     log_info("index pages: " + stridxpage);
+    log_info("files sent by " + string(use_sendfile ? "sendfile()" : "mmap() and writev()"));
+    log_info("file cache " + (file_cache_capacity ? "capacity = " + to_string(file_cache_capacity) + ", files up to " + to_string(small_file_limit) + " bytes kept in memory, " + to_string(small_file_memory) + " bytes at most" : string("disabled")));
     log_info("max_connection = " + to_string(max_connection));
     log_info("number of threads accepting connection requests = " + to_string(listen_ET ? 1 : accept_thread_num));
-    log_info("connection livetime = " + to_string(livetime_s) + "s, check interval = " + to_string(check_interval_s) + "s");
+    log_info("SO_REUSEPORT " + string(this->reuseport ? "enabled" : "disabled") + (worker_process ? ", running as worker process " + to_string(getpid()) : ""));
+    if (reactor_num) {
+        log_info("number of sub reactors = " + to_string(reactor_num) + ", balance policy = " + string(balance == ROUND_ROBIN ? "round robin" : balance == LEAST_LOAD ? "least load" : "incoming CPU"));
+    }
+    else {
+        log_info("no sub reactor; the main reactor serves connections");
+    }
+    if (mode == POOL) {
+        log_info("socket IO done by working threads");
+    }
+    else if (mode == INLINE) {
+        log_info("socket IO done by reactor threads");
+    }
+    else {
+        log_info("socket IO done by reactor threads, except writing responses larger than " + to_string(inline_write_limit) + " bytes by working threads");
+    }
+    log_info("connection livetime = " + to_string(livetime_ms) + "ms, header timeout = " + to_string(header_timeout_ms) + "ms, body timeout = " + to_string(body_timeout_ms) + "ms, write timeout = " + to_string(write_timeout_ms) + "ms, timer tick = " + to_string(tick_ms) + "ms");
     log_info("logger " + string(enable_logger ? "enabled" : "disabled"));
     if (enable_logger) {
         log_info("\tlog path = " + log_path + ", logging mode = " + string(log_async ? "async" : "sync"));
     }
     log_info("number of working threads = " + to_string(nthreads) + ", task queue capacity = " + to_string(thread_pool_queue_capacity));
+    log_info(string("thread pool scheduling: ") + (work_stealing ? "work stealing" : "shared queue"));
+    if (affinity == FLOATING) {
+        log_info("threads floating");
+    }
+    else {
+        log_info("threads pinned to " + string(affinity == PIN_CORE ? "cores" : "NUMA nodes") + ", " + to_string(cpu_topology::cpus().size()) + " CPUs on " + to_string(cpu_topology::nodes()) + " nodes");
+        //working threads pinned themselves before the logger was set up
+        if (tp.unpinned()) {
+            log_err(to_string(tp.unpinned()) + " of " + to_string(nthreads) + " working threads failed to be pinned");
+        }
+    }
+    log_info("new connections shed while queue delay or reactor lag exceeds " + (shed_delay_ms ? to_string(shed_delay_ms) + "ms" : string("forever")) + ", accepting paused at max_connection");
     log_info("=====================================================");
 }
 
 webserver::~webserver()
 {
-    close(listenfd);
+    for (auto fd : listenfds) {
+        close(fd);
+    }
+    pthread_mutex_destroy(&accept_mutex);
 }
 
 void webserver::start()
 {
     log_info("webserver starting...");
-    init_listenfd(backlog);
-    ep.add(listenfd,listen_events);
-    log_info("ready to serve");
-    //this main thread is the reactor/dispatcher
-    auto events = ep.events();
-    while (true) {
-        size_t n = ep.wait(-1);
-        log_debug("returned from epoll wait. n = " + to_string(n));
-        for (size_t i(0); i < n; ++i) {
-            log_debug("i = " + to_string(i));
-            auto fd = events[i].data.fd;
-            log_debug("got event fd = " + to_string(fd));
-            auto pconn = timer.get(fd);
-            log_debug("got pconn");
-            string ipport("unknown host");  //to avoid expiration
-            if (pconn) {
-                ipport = str_ipport((*pconn)->addr());
+    if (!reuseport) {
+        listenfds.push_back(open_listenfd(backlog));
+        listen_reactors.push_back(&main_reactor);
+        main_reactor.poller().add(listenfds.back(),listen_events,listenfds.back());
+    }
+    //let the kernel spread new connections among sockets: every sub reactor accepts into itself
+    else if (!sub_reactors.empty()) {
+        for (auto &r : sub_reactors) {
+            listenfds.push_back(open_listenfd(backlog));
+            //the kernel prefers the socket of the reactor on the CPU a SYN comes in through
+            int cpu = r->cpu();
+            if (cpu >= 0 && setsockopt(listenfds.back(),SOL_SOCKET,SO_INCOMING_CPU,&cpu,sizeof(cpu)) < 0) {
+                log_warn("SO_INCOMING_CPU not set for reactor " + to_string(r->id()));
             }
+            listen_reactors.push_back(r.get());
+            r->poller().add(listenfds.back(),listen_events,listenfds.back());
+        }
+    }
+    //or every accepting thread has its own socket
+    else {
+        for (size_t i(0); i < accept_thread_num; ++i) {
+            listenfds.push_back(open_listenfd(backlog));
+            listen_reactors.push_back(&main_reactor);
+            main_reactor.poller().add(listenfds.back(),listen_events,listenfds.back());
+        }
+    }
+    for (auto &r : sub_reactors) {
+        r->start();
+    }
+    log_info("ready to serve");
+    //this main thread is the main reactor/dispatcher
+    main_reactor.loop();
+}
 
-            auto ev = events[i].events;
-            if (events[i].data.fd == listenfd) {
-                log_debug("\taccept event");
-                //if listenfd is in ET mode, then accept multi-threadedly!!!
-                size_t i(0);
-                do {
-                    tp.push(bind(&webserver::accept_handler,this));
-                    log_debug(string("\t") + "accept task pushed");
-                    ++i;
-                } while ((listen_events & EPOLLET) && i < accept_thread_num);
-            }
-            //peer close or error encounter
-            else if (ev & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                log_debug("\tpeer close or error event");
-                if (ev & EPOLLERR) {
-                    log_err("Error condition happened on the associated connection: " + ipport + ". events = " + to_string(ev) + ". closing...");
-                }
-                else if (ev & EPOLLRDHUP) {
-                    log_info("Stream socket peer closed connection, or shut down writing half of connection: " + ipport);
-                }
-                else {
-                    log_info("Hang up happened on the associated connection: " + ipport);
-                }
-                tp.push(bind(&webserver::close_handler,this,*pconn));
-                log_debug("\t" + ipport + " close task pushed");
-            }
-            //read
-            else if (ev & EPOLLIN) {
-                log_debug("\tread event");
-                //activate first
-                timer.activate(*pconn);
-                log_debug("\t" + ipport + " activated");
-                tp.push(bind(&webserver::read_handler,this,*pconn));
-                log_debug("\t" + ipport + " read task pushed");
-            }
-            //write
-            else if (ev & EPOLLOUT) {
-                log_debug("\twrite event");
-                timer.activate(*pconn);
-                log_debug("\t" + ipport + " activated");
-                tp.push(bind(&webserver::write_handler,this,*pconn));
-                log_debug("\t" + ipport + " write task pushed");
+void webserver::dispatch(reactor &r,epoll_event &event)
+{
+    auto tag = event.data.u64;
+    auto fd = conn_registry::tag_fd(tag);
+    log_debug("got event fd = " + to_string(fd));
+    auto ev = event.events;
+    if (is_listenfd(tag)) {
+        log_debug("\taccept event");
+        //sub reactors are waiting for connections; accept right here so that the dispatching is serialized
+        if (!sub_reactors.empty()) {
+            accept_handler(fd,reuseport ? &r : nullptr);
+            return;
+        }
+        //every accepting thread has its own socket, no need to race on one
+        //if listenfd is in ET mode, then accept multi-threadedly!!!
+        size_t i(0);
+        do {
+            //an edge missed would leave connections in the backlog until the next one comes; accept right here if the queue is full
+            if (!tp.push(bind(&webserver::accept_handler,this,fd,nullptr))) {
+                accept_handler(fd,nullptr);
+                return;
             }
-            else {
-                log_debug("\tunexpected event");
-                log_err("unexpected epoll event: " + to_string(ev));
+            log_debug(string("\t") + "accept task pushed");
+            ++i;
+        } while (!reuseport && (listen_events & EPOLLET) && i < accept_thread_num);
+        return;
+    }
+
+    auto e = r.conns().get(tag);
+    if (!e) {
+        log_debug("\tconnection of fd " + to_string(fd) + " has gone");
+        return;
+    }
+    //the one reference taken per event, moved along from here on
+    auto conn = e->conn;
+
+    //peer close or error encounter
+    if (ev & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        log_debug("\tpeer close or error event");
+        if (ev & EPOLLERR) {
+            log_err("Error condition happened on the associated connection: " + str_ipport(conn->addr()) + ". events = " + to_string(ev) + ". closing...");
+        }
+        else if (ev & EPOLLRDHUP) {
+            log_info("Stream socket peer closed connection, or shut down writing half of connection: " + str_ipport(conn->addr()));
+        }
+        else {
+            log_info("Hang up happened on the associated connection: " + str_ipport(conn->addr()));
+        }
+        //nothing to do but unregistering, which belongs to this thread anyway
+        remove_conn(r,tag,false);
+    }
+    //read
+    else if (ev & EPOLLIN) {
+        log_debug("\tread event");
+        //bytes arriving on an idle connection start a new request, whose header deadline is nearer than the idle one
+        //progress of the other phases only pushes deadlines back, which the timer works out as it fires
+        if (conn->phase() == http_conn::IDLE) {
+            arm_timer(r,*e,http_conn::HEADER,http_conn::now_ms());
+        }
+        //reading never blocks, and it's the only way to tell whether the request is a small one
+        //in HYBRID, opening or reading a file not cached is left to working threads
+        if (mode != POOL) {
+            read_handler(r,move(conn),mode == HYBRID);
+        }
+        else {
+            log_debug("\t" + str_ipport(conn->addr()) + " read task pushing");
+            push_conn_task(conn_task::READ,r,move(conn));
+        }
+    }
+    //write
+    else if (ev & EPOLLOUT) {
+        log_debug("\twrite event");
+        if (write_inline(conn)) {
+            write_handler(r,move(conn));
+        }
+        else {
+            log_debug("\t" + str_ipport(conn->addr()) + " write task pushing");
+            push_conn_task(conn_task::WRITE,r,move(conn));
+        }
+    }
+    else {
+        log_debug("\tunexpected event");
+        log_err("unexpected epoll event: " + to_string(ev));
+    }
+}
+
+void webserver::push_conn_task(conn_task::kind what,reactor &r,shared_ptr<http_conn> &&conn)
+{
+    //tasks of a connection go to the same worker when work stealing, one on the reactor's node if pinned
+    auto fd = conn->fd();
+    size_t affinity = fd;
+    if (r.node() >= 0 && !node_workers[r.node()].empty()) {
+        auto &local = node_workers[r.node()];
+        affinity = local[fd % local.size()];
+    }
+    small_task task(conn_task{what,now_us(),this,&r,move(conn)});
+    if (!tp.push(move(task),affinity)) {
+        log_warn("task queue full, event of fd " + to_string(fd) + " served by reactor " + to_string(r.id()));
+        task();
+    }
+}
+
+void webserver::shed(int clientfd)
+{
+    //a new socket's send buffer is empty, so it takes the whole response
+    if (send(clientfd,busy_response.data(),busy_response.size(),MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+        log_debug("503 to fd " + to_string(clientfd) + " not sent");
+    }
+    //closed with the request unread, the socket would be reset and the 503 lost with it
+    //so FIN after the response, and take in what has arrived; bounded, since this runs in an accepting thread
+    shutdown(clientfd,SHUT_WR);
+    char discard[4096];
+    for (size_t i(0); i < 16 && recv(clientfd,discard,sizeof(discard),MSG_DONTWAIT) > 0; ++i);
+    close(clientfd);
+    n_shed.fetch_add(1,memory_order_relaxed);
+}
+
+bool webserver::overloaded() const
+{
+    if (!shed_delay_us) {
+        return false;
+    }
+    uint32_t lag = 0;
+    for (size_t i(0); i <= sub_reactors.size(); ++i) {
+        lag = max(lag,loop_lag_us[i].load(memory_order_relaxed));
+    }
+    return queue_delay_us.load(memory_order_relaxed) > shed_delay_us || lag > shed_delay_us;
+}
+
+void webserver::pause_accept()
+{
+    pthread_mutex_lock(&accept_mutex);
+    if (!accept_paused.load(memory_order_relaxed)) {
+        //new connections wait in the backlog meanwhile
+        for (size_t i(0); i < listenfds.size(); ++i) {
+            listen_reactors[i]->poller().del(listenfds[i]);
+        }
+        accept_paused.store(true,memory_order_relaxed);
+        log_warn("max_connection reached, accepting paused");
+    }
+    pthread_mutex_unlock(&accept_mutex);
+}
+
+void webserver::resume_accept()
+{
+    //some room below max_connection, so as not to flip for every connection closed
+    if (!accept_paused.load(memory_order_relaxed) || http_conn::conn_count() > max_connection - max_connection / 8) {
+        return;
+    }
+    pthread_mutex_lock(&accept_mutex);
+    if (accept_paused.load(memory_order_relaxed)) {
+        //a listen socket with connections waiting is ready as soon as added, in ET mode too
+        for (size_t i(0); i < listenfds.size(); ++i) {
+            listen_reactors[i]->poller().add(listenfds[i],listen_events,listenfds[i]);
+        }
+        accept_paused.store(false,memory_order_relaxed);
+        log_info("accepting resumed");
+    }
+    pthread_mutex_unlock(&accept_mutex);
+}
+
+void webserver::overload_tick()
+{
+    //nothing queued, nothing to measure the delay by
+    if (tp.empty()) {
+        queue_delay_us.store(queue_delay_us.load(memory_order_relaxed) / 2,memory_order_relaxed);
+    }
+    resume_accept();
+}
+
+cpu_set_t webserver::placement(affinity_policy affinity,size_t slot,int &node)
+{
+    auto &cpus = cpu_topology::cpus();
+    int cpu = cpus[slot % cpus.size()];
+    node = cpu_topology::node_of(cpu);
+    return affinity == PIN_CORE ? cpu_topology::cpu_mask(cpu) : cpu_topology::node_mask(node);
+}
+
+vector<cpu_set_t> webserver::worker_masks(affinity_policy affinity,size_t reactor_num,size_t nthreads)
+{
+    vector<cpu_set_t> masks;
+    if (affinity != FLOATING) {
+        int node;
+        for (size_t i(0); i < nthreads; ++i) {
+            masks.push_back(placement(affinity,reactor_num + 1 + i,node));
+        }
+    }
+    return masks;
+}
+
+reactor &webserver::pick_reactor(int clientfd)
+{
+    if (sub_reactors.empty()) {
+        return main_reactor;
+    }
+    int cpu;
+    socklen_t len = sizeof(cpu);
+    if (balance == INCOMING_CPU && getsockopt(clientfd,SOL_SOCKET,SO_INCOMING_CPU,&cpu,&len) == 0 && cpu >= 0) {
+        //the reactor on that very CPU, or in turn among those on its node
+        if (static_cast<size_t>(cpu) < cpu_reactor.size() && cpu_reactor[cpu]) {
+            return *cpu_reactor[cpu];
+        }
+        int node = cpu_topology::node_of(cpu);
+        if (node >= 0 && static_cast<size_t>(node) < node_reactors.size() && !node_reactors[node].empty()) {
+            auto &local = node_reactors[node];
+            next_reactor = (next_reactor + 1) % local.size();
+            return *local[next_reactor];
+        }
+        //floating reactors; still, connections coming in through one CPU share a reactor
+        return *sub_reactors[cpu % sub_reactors.size()];
+    }
+    //only the main reactor thread accepts when there're sub reactors, so no lock needed
+    if (balance == LEAST_LOAD) {
+        size_t least(0);
+        for (size_t i(1); i < sub_reactors.size(); ++i) {
+            if (sub_reactors[i]->load() < sub_reactors[least]->load()) {
+                least = i;
             }
         }
+        return *sub_reactors[least];
     }
+    next_reactor = (next_reactor + 1) % sub_reactors.size();
+    return *sub_reactors[next_reactor];
 }
 
-void webserver::accept_handler()
+void webserver::accept_handler(int listenfd,reactor *home)
 {
     do {
         sockaddr_in addr;
@@ -188,113 +494,240 @@ void webserver::accept_handler()
         if (clientfd < 0) {
             break;
         }
-        auto ipport = str_ipport(addr);
-        log_info("accept connection from " + ipport);
+        log_info("accept connection from " + str_ipport(addr));
+        //the rest stay in the backlog until there's room
         if (http_conn::conn_count() >= max_connection) {
-            //send 503
-            tp.push(bind(send_error_response,clientfd,503));
-            log_warn("connection from " + ipport + " is rejected due to server busy");
+            shed(clientfd);
+            log_warn("connection from " + str_ipport(addr) + " is rejected due to max_connection");
+            pause_accept();
+            break;
+        }
+        //working threads or reactors are behind; better turn it away at once than to serve it late
+        if (overloaded()) {
+            shed(clientfd);
+            log_warn("connection from " + str_ipport(addr) + " is rejected due to server busy");
             continue;
         }
         set_nonblock(clientfd);
-        //construct a new http connection and time it
-        auto sp = make_shared<http_conn>(clientfd,addr,root,index_pages);
-        timer.add(sp,[ipport,this](shared_ptr<http_conn> conn,bool expired){
-            if (expired) {
-                log_info("connection from " + ipport + " timeout. closing");
-            }
-            else {
-                log_info("close connection from " + ipport);
-            }
-            ep.del(conn->fd());
-        });   //no call back is needed, as http_conn's destructor will do anything necessary
-        log_debug(ipport + " added to timer");
-        //then add to interest list
-        ep.add(clientfd,conn_events | EPOLLIN);
-        log_debug(ipport + " added to IN list");
+        //the connection stays in this reactor until closed
+        auto &r = home ? *home : pick_reactor(clientfd);
+        r.incr_load();
+        //take a connection object in the reactor, whose thread may be pinned to a NUMA node, so that the objects its pool makes are local
+        //right here if this is the reactor, without a task to queue
+        if (r.in_loop_thread()) {
+            add_conn(r,conn_pools[r.id()]->acquire(clientfd,addr));
+        }
+        else {
+            r.run_in_loop([this,&r,clientfd,addr]() {
+                add_conn(r,conn_pools[r.id()]->acquire(clientfd,addr));
+            });
+        }
     } while ((listen_events & EPOLLET));
 }
 
-void webserver::close_handler(shared_ptr<http_conn> conn)
+void webserver::add_conn(reactor &r,shared_ptr<http_conn> conn)
+{
+    conn->set_tag(r.conns().insert(conn));
+    //time it
+    rearm_timer(r,conn->tag());
+    log_debug(str_ipport(conn->addr()) + " added to timer of reactor " + to_string(r.id()));
+    //then add to interest list
+    r.poller().add(conn->fd(),conn_events | EPOLLIN,conn->tag());
+    log_debug(str_ipport(conn->addr()) + " added to IN list");
+}
+
+void webserver::close_handler(reactor &r,shared_ptr<http_conn> conn)
+{
+    r.run_in_loop(bind(&webserver::remove_conn,this,ref(r),conn->tag(),false));
+}
+
+void webserver::remove_conn(reactor &r,uint64_t tag,bool expired)
 {
-    timer.invalidate(conn);
+    auto e = r.conns().get(tag);
+    //closed already
+    if (!e) {
+        return;
+    }
+    if (expired) {
+        log_info("connection from " + str_ipport(e->conn->addr()) + " timeout. closing");
+    }
+    else {
+        log_info("close connection from " + str_ipport(e->conn->addr()));
+    }
+    if (e->timer != timer_wheel::npos) {
+        r.timers().cancel(e->timer);
+    }
+    r.poller().del(conn_registry::tag_fd(tag));
+    r.decr_load();
+    //the fd is closed as the registry drops the connection, so it can't be reused before the slot is cleared
+    r.conns().erase(tag);
+    resume_accept();
+}
+
+size_t webserver::timeout_of(http_conn::conn_phase phase) const
+{
+    switch (phase) {
+        case http_conn::HEADER:
+            return header_timeout_ms;
+        case http_conn::BODY:
+            return body_timeout_ms;
+        case http_conn::WRITE:
+            return write_timeout_ms;
+        default:
+            return livetime_ms;
+    }
+}
+
+int32_t webserver::time_left(http_conn::conn_phase phase,uint32_t since) const
+{
+    //since may be a tick ahead of the clock read here, which counts as no time passed
+    auto elapsed = max(static_cast<int32_t>(http_conn::now_ms() - since),0);
+    return static_cast<int32_t>(timeout_of(phase)) - elapsed;
+}
+
+void webserver::arm_timer(reactor &r,conn_registry::entry &e,http_conn::conn_phase phase,uint32_t since)
+{
+    auto left = max(time_left(phase,since),0);
+    if (e.timer == timer_wheel::npos) {
+        e.timer = r.timers().add(e.conn->tag(),left);
+    }
+    else {
+        r.timers().refresh(e.timer,left);
+    }
+}
+
+void webserver::rearm_timer(reactor &r,uint64_t tag)
+{
+    auto e = r.conns().get(tag);
+    if (e) {
+        auto st = e->conn->phase_since();
+        arm_timer(r,*e,st.first,st.second);
+    }
 }
 
-void webserver::read_handler(shared_ptr<http_conn> conn)
+void webserver::expire_handler(reactor &r,uint64_t tag)
+{
+    auto e = r.conns().get(tag);
+    if (!e) {
+        return;
+    }
+    //the timer is gone
+    e->timer = timer_wheel::npos;
+    //working threads move connections on and mark progress without touching timers
+    //so the deadline is worked out only now, and the timer set again if it's not due yet
+    auto st = e->conn->phase_since();
+    if (time_left(st.first,st.second) > 0) {
+        arm_timer(r,*e,st.first,st.second);
+        return;
+    }
+    remove_conn(r,tag,true);
+}
+
+void webserver::read_handler(reactor &r,shared_ptr<http_conn> conn,bool cached_only)
 {
     //if connectin expired during waiting for served
     if (!conn) {
         return;
     }
     //if not expired, then it's likely to remain valid until writable
-    auto ipport = str_ipport(conn->addr());
     if (conn->read() < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-        tp.push(bind(&webserver::close_handler,this,conn));
-        log_debug("error read in " + ipport + ", close task pushed");
-        log_err("close " + ipport + " due to error read");
+        close_handler(r,conn);
+        log_debug("error read in " + str_ipport(conn->addr()) + ", closed");
+        log_err("close " + str_ipport(conn->addr()) + " due to error read");
         return;
     }
-    if (conn->ready_for_write()) {
-        log_debug("connection from " + ipport + " is ready for write, add to OUT list");
-        ep.mod(conn->fd(),conn_events | EPOLLOUT);
+    if (conn->ready_for_write(cached_only)) {
+        //the socket send buffer is almost always empty, so write at once rather than waiting for EPOLLOUT
+        //which is armed by write_handler only if the write comes back short
+        if (r.in_loop_thread() && !write_inline(conn)) {
+            log_debug(str_ipport(conn->addr()) + " write task pushing");
+            push_conn_task(conn_task::WRITE,r,move(conn));
+        }
+        else {
+            log_debug("connection from " + str_ipport(conn->addr()) + " is ready for write, writing");
+            write_handler(r,conn);
+        }
+    }
+    //what's read is kept, and the task goes on from the request parsed
+    else if (conn->cache_missed()) {
+        log_debug(str_ipport(conn->addr()) + " read task pushing, file not cached");
+        push_conn_task(conn_task::READ,r,move(conn));
     }
     else {
-        log_debug("connection from " + ipport + "is yet not ready for write, add to In list");
-        ep.mod(conn->fd(),conn_events | EPOLLIN);  //re-register because client fd's are in EPOLLONESHOT
+        log_debug("connection from " + str_ipport(conn->addr()) + "is yet not ready for write, add to In list");
+        r.poller().mod(conn->fd(),conn_events | EPOLLIN,conn->tag());  //re-register because client fd's are in EPOLLONESHOT
     }
 }
 
-void webserver::write_handler(shared_ptr<http_conn> conn)
+void webserver::write_handler(reactor &r,shared_ptr<http_conn> conn)
 {
     //if connectin expired during waiting for served
     if (!conn) {
         return;
     }
     //if not expired, then it's likely to remain valid until writable
-    auto ipport = str_ipport(conn->addr());
-    auto len = conn->write();
-    //complete
-    if (len == 0) {
-        log_debug("write to connection from " + ipport + " completed");
-        if (conn->persistent()) {
+    ssize_t len;
+    //requests pipelined behind the batch just written are served without waiting for another read event
+    while ((len = conn->write()) == 0 && conn->persistent()) {
+        log_debug("write to connection from " + str_ipport(conn->addr()) + " completed");
+        conn->reset();
+        //the same as read_handler() does in the reactor for HYBRID
+        if (!conn->ready_for_write(mode == HYBRID && r.in_loop_thread())) {
+            if (conn->cache_missed()) {
+                log_debug(str_ipport(conn->addr()) + " read task pushing, file not cached");
+                push_conn_task(conn_task::READ,r,move(conn));
+                return;
+            }
             //wait for next read event
-            log_debug("connection from " + ipport + " is persistent, add to IN list");
-            conn->reset();
-            ep.mod(conn->fd(),conn_events | EPOLLIN);
+            log_debug("connection from " + str_ipport(conn->addr()) + " is persistent, add to IN list");
+            //the deadline of a request partly pipelined behind may be nearer than the timer, which no event would tell the loop about
+            //an idle one is only further, and left to the timer to work out
+            if (conn->phase() != http_conn::IDLE) {
+                r.run_in_loop(bind(&webserver::rearm_timer,this,ref(r),conn->tag()));
+            }
+            r.poller().mod(conn->fd(),conn_events | EPOLLIN,conn->tag());
+            return;
         }
-        else {
-            //close
-            log_debug("connection from " + ipport + " is not persistent, closing");
-            timer.invalidate(conn);
+        log_debug("connection from " + str_ipport(conn->addr()) + " has requests pipelined, writing");
+        if (r.in_loop_thread() && !write_inline(conn)) {
+            log_debug(str_ipport(conn->addr()) + " write task pushing");
+            push_conn_task(conn_task::WRITE,r,move(conn));
+            return;
         }
     }
+    //complete
+    if (len == 0) {
+        //close
+        log_debug("connection from " + str_ipport(conn->addr()) + " is not persistent, closing");
+        close_handler(r,conn);
+    }
     //in ET mode
     else if (conn_events & EPOLLET) {
         if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
             //write would block or interrupted
-            log_debug("write to " + ipport + " was interrupted or would block, add to OUT list");
-            ep.mod(conn->fd(),conn_events | EPOLLOUT);
+            log_debug("write to " + str_ipport(conn->addr()) + " was interrupted or would block, add to OUT list");
+            r.poller().mod(conn->fd(),conn_events | EPOLLOUT,conn->tag());
         }
         else {
-            log_debug("close connection from " + ipport + " due to write error");
-            timer.invalidate(conn);
+            log_debug("close connection from " + str_ipport(conn->addr()) + " due to write error");
+            close_handler(r,conn);
         }
     }
     //in LT mode
     else if (len > 0) {
-        log_debug("connectino from " + ipport + " is in LT, add to OUT list");
+        log_debug("connectino from " + str_ipport(conn->addr()) + " is in LT, add to OUT list");
         //all data may not be written
-        ep.mod(conn->fd(),conn_events | EPOLLOUT);
+        r.poller().mod(conn->fd(),conn_events | EPOLLOUT,conn->tag());
     }
     //in LT mode and len < 0
     else {
         if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-            log_debug("write to " + ipport + " was interrupted or would block, add to OUT list");
-            ep.mod(conn->fd(),conn_events | EPOLLOUT);
+            log_debug("write to " + str_ipport(conn->addr()) + " was interrupted or would block, add to OUT list");
+            r.poller().mod(conn->fd(),conn_events | EPOLLOUT,conn->tag());
         }
         else {
-            log_debug("connectino from " + ipport + " is in LT, add to OUT list");
-            ep.mod(conn->fd(),conn_events | EPOLLOUT);
+            log_debug("connectino from " + str_ipport(conn->addr()) + " is in LT, add to OUT list");
+            r.poller().mod(conn->fd(),conn_events | EPOLLOUT,conn->tag());
         }
     }
 }
@@ -311,15 +744,25 @@ void webserver::init_event_mask(bool listen_ET,bool conn_ET)
     }
 }
 
-void webserver::init_listenfd(int backlog)
+int webserver::open_listenfd(int backlog)
 {
-    listenfd = socket(AF_INET,SOCK_STREAM,0);
+    int listenfd = socket(AF_INET,SOCK_STREAM,0);
     if (listenfd < 0) {
         log_err("listen socket creation init failed");
         throw runtime_error("socket error");
     }
     //set non-block
     set_nonblock(listenfd);
+    //restart without waiting for TIME_WAIT, and share the port if asked
+    int on = 1;
+    if (setsockopt(listenfd,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on)) < 0) {
+        log_err("listen socket SO_REUSEADDR failed");
+        throw runtime_error("setsockopt error");
+    }
+    if (reuseport && setsockopt(listenfd,SOL_SOCKET,SO_REUSEPORT,&on,sizeof(on)) < 0) {
+        log_err("listen socket SO_REUSEPORT failed");
+        throw runtime_error("setsockopt error");
+    }
 
     sockaddr_in to_bind;
     to_bind.sin_family = AF_INET;
@@ -335,6 +778,22 @@ void webserver::init_listenfd(int backlog)
         log_err("listen socket listen failed");
         throw runtime_error("listen error");
     }
+    return listenfd;
+}
+
+bool webserver::is_listenfd(uint64_t tag) const
+{
+    //listen sockets are registered with generation 0
+    if (conn_registry::tag_gen(tag) != 0) {
+        return false;
+    }
+    //a few at most
+    for (auto lfd : listenfds) {
+        if (conn_registry::tag_fd(tag) == lfd) {
+            return true;
+        }
+    }
+    return false;
 }
 
 void webserver::set_nonblock(int fd)
@@ -355,7 +814,7 @@ void webserver::set_nonblock(int fd)
 void *webserver::signal_handler_thrd_fn(void *arg)
 {
     auto ins = static_cast<webserver *>(arg);
-    //handling SIGALRM
+    //handling SIGINT and SIGQUIT
     while (true) {
         int signo;
         if (sigwait(&blocked_sigset, &signo) != 0) {
@@ -363,23 +822,33 @@ void *webserver::signal_handler_thrd_fn(void *arg)
             throw runtime_error("sigprocmask error");
         }
         switch (signo) {
-            case SIGALRM:
-                // dbg("about to broadcast");
-                // ins->tp.broadcast();
-                // dbg("broadcast done","about to run timer.sig_alarm()");
-                timer.sig_alarm();
-                log_info("current active connection: " + to_string(timer.size()));
-                break;
             case SIGINT:
             case SIGQUIT:
                 log_info(string((signo == SIGINT) ? "SIGINT" : "SIGQUIT") + " received. exiting...");
+                if (ins->files) {
+                    log_info("file cache hits = " + to_string(ins->files->hits()) + ", misses = " + to_string(ins->files->misses()) + ", memory = " + to_string(ins->files->memory()) + " bytes");
+                }
+                log_info("connections shed = " + to_string(ins->n_shed.load(memory_order_relaxed)));
+                for (size_t c(0); c < buffer_pool::nclass; ++c) {
+                    auto st = buffer_pool::class_stats(c);
+                    log_info("buffer pool " + to_string(buffer_pool::class_size[c]) + " bytes: malloc()ed = " + to_string(st.mallocs) + ", free()d = " + to_string(st.frees) + ", in depot = " + to_string(st.depot));
+                }
+                log_info("buffer pool oversize = " + to_string(buffer_pool::oversize()));
+                for (auto &pool : ins->conn_pools) {
+                    auto st = pool->get_stats();
+                    log_info("connection objects made = " + to_string(st.made) + ", free = " + to_string(st.free));
+                }
                 //wait for all jobs done
                 ins->tp.block();
                 dbg("thread pool block return");
                 logger::instance()->flush();
                 dbg("logger flush return");
-                ins->~webserver();
-                dbg("destructed");
+                //reactors are still waiting on their backends, so don't destroy them under their feet
+                //stop listening, and leave the rest to process termination
+                for (auto fd : ins->listenfds) {
+                    close(fd);
+                }
+                dbg("listen sockets closed");
                 //terminate process
                 ::exit(0);
                 break;
@@ -389,15 +858,57 @@ void *webserver::signal_handler_thrd_fn(void *arg)
     }
 }
 
-void webserver::send_error_response(int fd,int code)
+void webserver::fork_workers(size_t nprocess)
 {
-    scalable_buffer buf(4096);
-    http_response res;
-    res.init(code,buf);
-    //blocking write
-    do {
-        auto len = write(fd,buf.base(),buf.readable());
-        buf.retrieved(len);
-    } while (buf.readable());
-    close(fd);
+    if (nprocess <= 1) {
+        return;
+    }
+    //SIGCHLD is handled synchronously as well
+    sigset_t set = blocked_sigset;
+    if (sigaddset(&set,SIGCHLD) < 0 || pthread_sigmask(SIG_BLOCK,&set,nullptr) != 0) {
+        throw runtime_error("sigprocmask error");
+    }
+    std::unordered_set<pid_t> workers;
+    auto spawn = [&workers]() {
+        auto pid = fork();
+        if (pid < 0) {
+            throw runtime_error("fork error");
+        }
+        if (pid == 0) {
+            worker_process = true;
+            return true;
+        }
+        workers.insert(pid);
+        return false;
+    };
+    for (size_t i(0); i < nprocess; ++i) {
+        if (spawn()) {
+            return;
+        }
+    }
+    //master: restart crashed workers, and pass SIGINT/SIGQUIT on for graceful exit
+    bool exiting = false;
+    while (!workers.empty()) {
+        int signo;
+        if (sigwait(&set,&signo) != 0) {
+            throw runtime_error("sigwait error");
+        }
+        if (signo == SIGINT || signo == SIGQUIT) {
+            exiting = true;
+            for (auto pid : workers) {
+                kill(pid,signo);
+            }
+        }
+        else if (signo == SIGCHLD) {
+            pid_t pid;
+            int status;
+            while ((pid = waitpid(-1,&status,WNOHANG)) > 0) {
+                workers.erase(pid);
+                if (!exiting && spawn()) {
+                    return;
+                }
+            }
+        }
+    }
+    ::exit(0);
 }
\ No newline at end of file
@@ -3,13 +3,17 @@
 
 #include "useful.hh"
 #include "thread_pool/thread_pool.hh"
-#include "expirer/expirer.hh"
+#include "cpu_topology/cpu_topology.hh"
 #include "logger/logger.hh"
 #include "http_conn/http_conn.hh"
-#include "epoller/epoller.hh"
+#include "conn_pool/conn_pool.hh"
+#include "event_backend/event_backend.hh"
+#include "reactor/reactor.hh"
+#include "file_cache/file_cache.hh"
 
 #include <signal.h>
 #include <fcntl.h>
+#include <sys/wait.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <errno.h>
@@ -17,6 +21,7 @@
 #include <unordered_set>
 #include <stdexcept>
 #include <memory>
+#include <vector>
 
 //debug
 #define DBG_MACRO_DISABLE
@@ -25,74 +30,225 @@
 class webserver
 {
 public:
+    //how accepted connections are handed to sub reactors
+    enum balance_policy {
+        ROUND_ROBIN,
+        LEAST_LOAD,
+        INCOMING_CPU    //<the reactor on the CPU, or else the NUMA node, that took the connection's packets in (SO_INCOMING_CPU)
+    };
+    //which threads do socket IO of connections
+    enum dispatch_mode {
+        POOL,   //<working threads of thread pool
+        INLINE, //<the reactor owning the connection
+        HYBRID  //<the reactor, except writing responses larger than inline_write_limit, which goes to working threads
+    };
+    //where reactor threads and working threads run
+    //reactors come first, then working threads, placed in turn on CPUs interleaved among NUMA nodes
+    //the signal thread and the logger thread go with the main reactor's node
+    enum affinity_policy {
+        FLOATING,   //<anywhere, as the scheduler likes
+        PIN_CORE,   //<one CPU each
+        PIN_NODE    //<any CPU of one NUMA node each
+    };
     webserver(
         //normal
         unsigned port,
         bool listen_ET,
         bool conn_ET,
         size_t max_event,
+        event_backend::type backend,
         int backlog,
         std::string root,
         const std::set<std::string> &index_pages,
+        bool use_sendfile,
+        size_t file_cache_capacity,
+        size_t small_file_limit,
+        size_t small_file_memory,
         size_t max_connection,
         size_t accept_thread_num,
+        //reactor
+        size_t reactor_num,
+        balance_policy balance,
+        bool reuseport,
+        dispatch_mode mode,
+        size_t inline_write_limit,
         //about expire
-        size_t livetime_s,
-        size_t check_interval_s,
+        size_t livetime_ms,
+        size_t header_timeout_ms,
+        size_t body_timeout_ms,
+        size_t write_timeout_ms,
+        size_t tick_ms,
         //logger
         bool enable_logger,
         logger::log_level log_level,
         std::string log_path,
         bool log_async,
-        size_t log_queue_capacity,
+        size_t log_ring_size,
         //thread pool
         size_t nthreads,
-        size_t thread_pool_queue_capacity
+        size_t thread_pool_queue_capacity,
+        bool work_stealing,
+        //placement
+        affinity_policy affinity,
+        //overload
+        size_t shed_delay_ms
     );
     ~webserver();
     //start socket listening and processing
     void start();
+    //fork nprocess worker processes sharing the port through SO_REUSEPORT, and supervise them in the calling process
+    //must be called before any webserver is constructed, because only the calling thread survives fork()
+    //returns in worker processes only
+    static void fork_workers(size_t nprocess);
 
 private:
-    //hash function for http_conn
-    //use fd as identity
-    struct http_conn_ptr_hasher {
-        size_t operator()(std::shared_ptr<http_conn> conn) const {
-            //for debug
-            if (!conn.get())
-                throw std::runtime_error("shared_ptr<http_conn> is null");
-            log_debug("from hasher: conn->fd() = " + std::to_string(conn->fd()));
-            return static_cast<size_t>(conn->fd());
-        }
-    };
-    static expirer<std::shared_ptr<http_conn>,http_conn_ptr_hasher> timer;
     //the function the thread dedicated for signal handling runs
     static void *signal_handler_thrd_fn(void *arg);
     //set fd in non-block mode
     static void set_nonblock(int fd);
-    //send error http response by http code
-    static void send_error_response(int fd,int code);
+    //microseconds of monotonic clock, wrapping around; only differences make sense
+    static uint32_t now_us() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC,&ts);
+        return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+    //true in processes forked by fork_workers(), whose listen sockets must share the port
+    static bool worker_process;
 
     unsigned port;
-    epoller ep;
-    std::string root;
+    //root and index pages, looked at by every connection
+    http_conn::config conf;
+    //connection objects of each reactor, by id
+    //declared ahead of the reactors, as the connections left in their registries go back to these pools as they're destroyed
+    std::vector<std::unique_ptr<conn_pool>> conn_pools;
+    //listens, and serves connections as well if there's no sub reactor
+    reactor main_reactor;
+    //each one runs in its own thread and does socket IO itself
+    std::vector<std::unique_ptr<reactor>> sub_reactors;
+    balance_policy balance;
+    size_t next_reactor = 0;
+    //sub reactors pinned, by the CPU pinned to if only one (null if none), and by NUMA node; empty if floating
+    std::vector<reactor *> cpu_reactor;
+    std::vector<std::vector<reactor *>> node_reactors;
+    affinity_policy affinity;
+    //working threads on each NUMA node, when pinned
+    std::vector<std::vector<size_t>> node_workers;
+    dispatch_mode mode;
+    size_t inline_write_limit;
     thread_pool tp;
-    std::set<std::string> index_pages;
+    //null if disabled
+    std::unique_ptr<file_cache> files;
     size_t max_connection;
     int backlog;
     uint32_t listen_events;
     uint32_t conn_events;
     size_t accept_thread_num;
+    //timeouts by phase of connection
+    size_t livetime_ms;
+    size_t header_timeout_ms;
+    size_t body_timeout_ms;
+    size_t write_timeout_ms;
+
+    //overload control
+    //new connections are turned away with 503 while tasks wait in the queue, or events in reactors, longer than this on average; 0 to disable
+    uint32_t shed_delay_us;
+    //moving average of the time tasks wait in the queue, updated by working threads
+    std::atomic<uint32_t> queue_delay_us{0};
+    //moving average of the longest event batch every tick, which is what work done in reactors (INLINE, HYBRID) waits behind
+    //one for each reactor, by id, so that a stalled one isn't averaged away by idle ones
+    std::unique_ptr<std::atomic<uint32_t>[]> loop_lag_us;
+    //listen sockets are taken off their reactors while connections are at max_connection
+    std::atomic<bool> accept_paused{false};
+    pthread_mutex_t accept_mutex;
+    //sent as is to connections turned away
+    std::string busy_response;
+    std::atomic<size_t> n_shed{0};
 
-    int listenfd;
+    //one socket, or one SO_REUSEPORT socket per accepting thread or sub reactor
+    std::vector<int> listenfds;
+    std::vector<reactor *> listen_reactors;   //<polling each of listenfds
+    bool reuseport;
 
-    void init_listenfd(int backlog);
+    int open_listenfd(int backlog);
+    bool is_listenfd(uint64_t tag) const;
     void init_event_mask(bool listen_ET,bool conn_ET);
+    //called by every reactor for every ready event
+    void dispatch(reactor &r,epoll_event &ev);
+    //choose the reactor the new connection of clientfd goes to
+    reactor &pick_reactor(int clientfd);
+    //the mask of the slot-th thread placed, and its NUMA node
+    static cpu_set_t placement(affinity_policy affinity,size_t slot,int &node);
+    static std::vector<cpu_set_t> worker_masks(affinity_policy affinity,size_t reactor_num,size_t nthreads);
+    //whether new connections are to be turned away for the queue delay, or the lag of the most lagging reactor
+    bool overloaded() const;
+    //lossy under contention, which a moving average doesn't mind
+    static void note_delay(std::atomic<uint32_t> &avg_us,uint32_t delay_us) {
+        auto avg = avg_us.load(std::memory_order_relaxed);
+        avg_us.store(avg - avg / 8 + delay_us / 8,std::memory_order_relaxed);
+    }
+    void note_queue_delay(uint32_t delay_us) {
+        note_delay(queue_delay_us,delay_us);
+    }
+    //every reactor's tick: sample how long its event batches take
+    void lag_tick(reactor &r) {
+        note_delay(loop_lag_us[r.id()],r.take_batch_us());
+    }
+    //write the canned 503 without blocking, shut the writing side, drain what the client has sent, and close
+    void shed(int clientfd);
+    //stop and restart polling listen sockets; from any thread
+    void pause_accept();
+    void resume_accept();
+    //main reactor's tick: let the queue delay fade out while the queue stays empty, and resume accepting if possible
+    void overload_tick();
     //accept handler is thread-safe because accept(), epoll_ctl() are all thread-safe
-    void accept_handler();
-    void close_handler(std::shared_ptr<http_conn> conn);
-    void read_handler(std::shared_ptr<http_conn> conn);
-    void write_handler(std::shared_ptr<http_conn> conn);
+    //connections accepted go to home if given, otherwise to pick_reactor()
+    void accept_handler(int listenfd,reactor *home);
+    //register conn in r; must run in r's loop thread
+    void add_conn(reactor &r,std::shared_ptr<http_conn> conn);
+    //close conn of r from any thread
+    void close_handler(reactor &r,std::shared_ptr<http_conn> conn);
+    //unregister and close the connection of tag; must run in r's loop thread
+    void remove_conn(reactor &r,uint64_t tag,bool expired);
+    size_t timeout_of(http_conn::conn_phase phase) const;
+    //ms left before the deadline of phase counted from since, negative if past
+    int32_t time_left(http_conn::conn_phase phase,uint32_t since) const;
+    //set the timer of e to the deadline of phase counted from since
+    void arm_timer(reactor &r,conn_registry::entry &e,http_conn::conn_phase phase,uint32_t since);
+    //set the timer of the connection of tag to the deadline of the phase it's in now; must run in r's loop thread
+    void rearm_timer(reactor &r,uint64_t tag);
+    //called by every reactor for every timer due
+    void expire_handler(reactor &r,uint64_t tag);
+    //with cached_only, requests whose responses would touch the file system are handed to the thread pool instead of being answered here
+    void read_handler(reactor &r,std::shared_ptr<http_conn> conn,bool cached_only = false);
+    void write_handler(reactor &r,std::shared_ptr<http_conn> conn);
+    //a read or write of a connection handed to the thread pool
+    //fits in a small_task, and the reference to the connection is moved all the way into the handler
+    struct conn_task {
+        enum kind : uint8_t {
+            READ,
+            WRITE
+        };
+        kind what;
+        uint32_t queued_us; //<when pushed, for queue delay
+        webserver *server;
+        reactor *r;
+        std::shared_ptr<http_conn> conn;
+        void operator()() {
+            server->note_queue_delay(now_us() - queued_us);
+            if (what == READ) {
+                server->read_handler(*r,std::move(conn));
+            }
+            else {
+                server->write_handler(*r,std::move(conn));
+            }
+        }
+    };
+    //run in the calling reactor if the queue is full, since an event of a connection in EPOLLONESHOT dropped would leave it hanging until timed out
+    void push_conn_task(conn_task::kind what,reactor &r,std::shared_ptr<http_conn> &&conn);
+    //whether the response of conn is written by reactor threads
+    bool write_inline(const std::shared_ptr<http_conn> &conn) const {
+        return mode == INLINE || (mode == HYBRID && conn->to_write() <= inline_write_limit);
+    }
 };
 
 #endif //WEBSERVER_HH
\ No newline at end of file